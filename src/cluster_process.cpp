@@ -0,0 +1,286 @@
+
+#include "cluster_process.hpp"
+#include "world_snapshot.hpp"
+#include "experiment_utils.hpp"
+#include <math-core/geom.hpp>
+#include <boost/bind.hpp>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+
+using namespace math_core;
+
+
+namespace point_process_experiment_core {
+
+
+  //=========================================================================
+
+  // Description:
+  // Fills the offspring batch with the kernel's offsets (offspring
+  // are then shifted by their parent)
+  static void
+  fill_kernel_offsets( point_batch_t& offspring,
+		       const cluster_process_t& process,
+		       rng_stream_t& rng )
+  {
+    const std::size_t dimension = offspring.dimension();
+    const std::size_t n = offspring.size();
+    if( n == 0 ) {
+      return;
+    }
+
+    if( process.kernel == THOMAS_KERNEL ) {
+      for( std::size_t d = 0; d < dimension; ++d ) {
+	fill_gaussian( &offspring.coordinates[d][0], n, 0.0, process.scale, rng );
+      }
+      return;
+    }
+
+    // uniform in the ball: a uniform direction (normalized gaussian)
+    // at radius scale * u^(1/dimension)
+    std::vector<double> norm( n, 0.0 );
+    for( std::size_t d = 0; d < dimension; ++d ) {
+      double* x = &offspring.coordinates[d][0];
+      fill_gaussian( x, n, 0.0, 1.0, rng );
+      for( std::size_t i = 0; i < n; ++i ) {
+	norm[i] += x[i] * x[i];
+      }
+    }
+    std::vector<double> radius( n );
+    fill_uniform( &radius[0], n, 0.0, 1.0, rng );
+    const double inverse_dimension = 1.0 / dimension;
+    for( std::size_t i = 0; i < n; ++i ) {
+      norm[i] = ( norm[i] > 0 )
+	? process.scale * std::pow( radius[i], inverse_dimension ) / std::sqrt( norm[i] )
+	: 0.0;
+    }
+    for( std::size_t d = 0; d < dimension; ++d ) {
+      double* x = &offspring.coordinates[d][0];
+      for( std::size_t i = 0; i < n; ++i ) {
+	x[i] *= norm[i];
+      }
+    }
+  }
+
+  //=========================================================================
+
+  // Description:
+  // Generates the clusters of the parents of one tile, clipped to
+  // the window
+  static point_batch_t
+  generate_tile( const std::vector<double>& tile_start,
+		 const std::vector<double>& tile_end,
+		 const nd_aabox_t& window,
+		 const cluster_process_t& process,
+		 rng_stream_t& rng )
+  {
+    const std::size_t dimension = tile_start.size();
+
+    // the parents, uniform in the tile
+    double volume = 1;
+    for( std::size_t d = 0; d < dimension; ++d ) {
+      volume *= tile_end[d] - tile_start[d];
+    }
+    const std::size_t num_parents = rng.poisson( process.parent_intensity * volume );
+    point_batch_t parents( dimension, num_parents );
+    if( num_parents == 0 ) {
+      return point_batch_t( dimension, 0 );
+    }
+    for( std::size_t d = 0; d < dimension; ++d ) {
+      fill_uniform( &parents.coordinates[d][0], num_parents,
+		    tile_start[d], tile_end[d], rng );
+    }
+
+    // the number of offspring of each parent
+    std::vector<std::size_t> offsets( num_parents + 1, 0 );
+    for( std::size_t p = 0; p < num_parents; ++p ) {
+      offsets[ p + 1 ] = offsets[ p ] + rng.poisson( process.mean_cluster_size );
+    }
+
+    // spread them around their parents
+    point_batch_t offspring( dimension, offsets[ num_parents ] );
+    if( offspring.size() == 0 ) {
+      return offspring;
+    }
+    fill_kernel_offsets( offspring, process, rng );
+    for( std::size_t d = 0; d < dimension; ++d ) {
+      double* x = &offspring.coordinates[d][0];
+      const double* parent = &parents.coordinates[d][0];
+      for( std::size_t p = 0; p < num_parents; ++p ) {
+	const double shift = parent[p];
+	for( std::size_t i = offsets[p]; i < offsets[ p + 1 ]; ++i ) {
+	  x[i] += shift;
+	}
+      }
+    }
+
+    clip_to_window( offspring, window );
+    return offspring;
+  }
+
+  //=========================================================================
+
+  std::size_t
+  generate_cluster_process( const nd_aabox_t& window,
+			    const cluster_process_t& process,
+			    const rng_stream_t& rng,
+			    const point_batch_sink_t& sink )
+  {
+    if( process.parent_intensity < 0 ||
+	process.mean_cluster_size < 0 ||
+	process.scale < 0 ) {
+      BOOST_THROW_EXCEPTION( std::domain_error( "A cluster process needs a non-negative parent intensity, cluster size and scale" ) );
+    }
+    const std::size_t dimension = window.start.n;
+
+    // the region parents are drawn from: the window grown by the
+    // reach of the kernel, and its tiles
+    double reach = ( process.kernel == THOMAS_KERNEL ) ? 4 * process.scale : process.scale;
+    std::vector<double> start( dimension ), end( dimension );
+    std::vector<unsigned long long> num_tiles( dimension, 1 );
+    unsigned long long total_tiles = 1;
+    for( std::size_t d = 0; d < dimension; ++d ) {
+      start[d] = window.start.coordinate[d] - reach;
+      end[d] = window.end.coordinate[d] + reach;
+      if( process.tile_size > 0 ) {
+	num_tiles[d] = (unsigned long long)std::max( 1.0, std::ceil( ( end[d] - start[d] ) / process.tile_size ) );
+      }
+      total_tiles *= num_tiles[d];
+    }
+
+    // generate each tile from its own stream (dimension 0 of the
+    // tile coordinates varies fastest)
+    std::size_t num_points = 0;
+    std::vector<double> tile_start( dimension ), tile_end( dimension );
+    for( unsigned long long k = 0; k < total_tiles; ++k ) {
+      unsigned long long rest = k;
+      for( std::size_t d = 0; d < dimension; ++d ) {
+	unsigned long long c = rest % num_tiles[d];
+	rest /= num_tiles[d];
+	if( process.tile_size > 0 ) {
+	  tile_start[d] = start[d] + c * process.tile_size;
+	  tile_end[d] = std::min( end[d], tile_start[d] + process.tile_size );
+	} else {
+	  tile_start[d] = start[d];
+	  tile_end[d] = end[d];
+	}
+      }
+      rng_stream_t tile_rng = rng.split( k );
+      point_batch_t points = generate_tile( tile_start, tile_end, window, process, tile_rng );
+      if( points.size() > 0 ) {
+	num_points += points.size();
+	sink( points );
+      }
+    }
+    return num_points;
+  }
+
+  //=========================================================================
+
+  // Description:
+  // A sink which appends the points to a vector
+  static void
+  append_points( std::vector<nd_point_t>* points,
+		 const point_batch_t& batch )
+  {
+    std::vector<nd_point_t> p = to_points( batch );
+    points->insert( points->end(), p.begin(), p.end() );
+  }
+
+  //=========================================================================
+
+  // Description:
+  // The ground truth of a cluster process world
+  static std::vector<nd_point_t>
+  cluster_process_groundtruth( const nd_aabox_t& window,
+			       const cluster_process_t& process,
+			       rng_stream_t& rng )
+  {
+    std::vector<nd_point_t> points;
+    generate_cluster_process( window, process, rng,
+			      boost::bind( &append_points, &points, _1 ) );
+    return points;
+  }
+
+  //=========================================================================
+
+  static nd_aabox_t
+  constant_window( const nd_aabox_t& window )
+  {
+    return window;
+  }
+
+  //=========================================================================
+
+  void
+  register_cluster_process_world
+  ( const std::string& id,
+    const nd_aabox_t& window,
+    const cluster_process_t& process )
+  {
+    register_seeded_world( id,
+			   boost::bind( &cluster_process_groundtruth, window, process, _1 ),
+			   boost::bind( &constant_window, window ) );
+  }
+
+  //=========================================================================
+
+  // Description:
+  // The ground truth of a snapshot cached cluster process world:
+  // streams the world into the snapshot unless there is a valid one,
+  // and reads it back (or generates it into memory if the snapshot
+  // cannot be written)
+  static std::vector<nd_point_t>
+  snapshot_cluster_process_groundtruth( const std::string& snapshot_filename,
+					const nd_aabox_t& window,
+					const cluster_process_t& process,
+					const unsigned long seed )
+  {
+    try {
+      world_snapshot_t snapshot( snapshot_filename );
+      return snapshot.points();
+    } catch( invalid_world_snapshot_exception& ) {
+      // missing or invalid, generate it
+    }
+
+    try {
+      world_snapshot_writer_t writer( snapshot_filename, window );
+      generate_cluster_process( window, process,
+				rng_stream_t( seed, WORLD_RNG_STREAM ),
+				boost::bind( &world_snapshot_writer_t::write, &writer, _1 ) );
+      writer.close();
+      return world_snapshot_t( snapshot_filename ).points();
+    } catch( invalid_world_snapshot_exception& ) {
+      // the snapshot cannot be written (e.g. a read only directory or
+      // a full disk), so generate the world into memory instead
+    }
+
+    std::vector<nd_point_t> points;
+    generate_cluster_process( window, process,
+			      rng_stream_t( seed, WORLD_RNG_STREAM ),
+			      boost::bind( &append_points, &points, _1 ) );
+    return points;
+  }
+
+  //=========================================================================
+
+  void
+  register_snapshot_cached_cluster_process_world
+  ( const std::string& id,
+    const std::string& snapshot_filename,
+    const nd_aabox_t& window,
+    const cluster_process_t& process,
+    const unsigned long seed )
+  {
+    register_world( id,
+		    boost::bind( &snapshot_cluster_process_groundtruth,
+				 snapshot_filename, window, process, seed ),
+		    boost::bind( &constant_window, window ) );
+  }
+
+  //=========================================================================
+
+}
@@ -0,0 +1,109 @@
+
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_cluster_process_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_cluster_process_HPP__
+
+#include "point_batch.hpp"
+#include "rng_stream.hpp"
+#include <math-core/types.hpp>
+#include <boost/function.hpp>
+#include <string>
+#include <cstddef>
+
+namespace point_process_experiment_core {
+
+
+  // Description:
+  // How the offspring of a parent are spread around it
+  enum cluster_kernel_t
+  {
+    // isotropic gaussian with sigma = scale (Thomas process)
+    THOMAS_KERNEL,
+
+    // uniform in the ball of radius = scale (Matern cluster process)
+    MATERN_KERNEL
+  };
+
+
+  // Description:
+  // A Neyman-Scott cluster process: poisson parents with the given
+  // intensity (expected parents per unit volume), each with a poisson
+  // number (mean_cluster_size) of offspring spread around it by the
+  // kernel. The offspring are the points of the world.
+  //
+  // It is generated in tiles of side tile_size (<= 0 is one tile):
+  // the parents of each tile come from their own random stream, so the
+  // world does not depend on the order the tiles are generated in and
+  // only one tile of points is in memory at a time.
+  struct cluster_process_t
+  {
+    cluster_kernel_t kernel;
+    double parent_intensity;
+    double mean_cluster_size;
+    double scale;
+    double tile_size;
+
+    cluster_process_t()
+      : kernel( THOMAS_KERNEL ),
+	parent_intensity( 0 ),
+	mean_cluster_size( 0 ),
+	scale( 0 ),
+	tile_size( 0 )
+    {}
+  };
+
+
+  // Description:
+  // Where a streaming generator puts each batch of generated points
+  // (e.g. world_snapshot_writer_t::write or cell_point_buckets_t::add)
+  typedef boost::function<void (const point_batch_t&)> point_batch_sink_t;
+
+
+  // Description:
+  // Generates the points of the cluster process inside the window,
+  // giving them to the sink a tile at a time, and returns the number
+  // of points generated.
+  //
+  // Parents are generated over the window grown by the reach of the
+  // kernel (4 sigma for Thomas, the radius for Matern), so clusters
+  // whose parent is just outside still put points inside. Tile k of
+  // that region draws from rng.split( k ).
+  // Throws std::domain_error for a negative intensity, cluster size
+  // or scale.
+  std::size_t
+  generate_cluster_process( const math_core::nd_aabox_t& window,
+			    const cluster_process_t& process,
+			    const rng_stream_t& rng,
+			    const point_batch_sink_t& sink );
+
+
+  // Description:
+  // Registers a seeded world (see register_seeded_world) which is the
+  // given cluster process in the window
+  void
+  register_cluster_process_world
+  ( const std::string& id,
+    const math_core::nd_aabox_t& window,
+    const cluster_process_t& process );
+
+
+  // Description:
+  // Registers a world (see register_world) which is the given cluster
+  // process in the window (drawn from rng_stream_t( seed,
+  // WORLD_RNG_STREAM )), streamed into the given snapshot file the
+  // first time it is asked for unless the snapshot already exists.
+  // Generating it only needs one tile of points in memory. If the
+  // snapshot cannot be written (e.g. a read only directory) the world
+  // is generated into memory instead.
+  // The snapshot is not checked against the process, so remove it
+  // when the process changes.
+  void
+  register_snapshot_cached_cluster_process_world
+  ( const std::string& id,
+    const std::string& snapshot_filename,
+    const math_core::nd_aabox_t& window,
+    const cluster_process_t& process,
+    const unsigned long seed = 0 );
+
+}
+
+#endif
@@ -1,9 +1,16 @@
 
 #include "data_io.hpp"
+#include "parallel.hpp"
 #include <iostream>
 #include <math-core/geom.hpp>
+#include <boost/bind.hpp>
+#include <boost/exception/errinfo_at_line.hpp>
 #include <string>
-#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+#include <locale.h>
 
 #define VERBOSE false
 
@@ -15,44 +22,344 @@ namespace point_process_experiment_core {
 
   //===========================================================================
 
-  std::vector<nd_point_t> 
-  parse_points_from_ssv_stream( std::istream& is, bool lisp_format )
+  // inputs smaller than this are parsed on the calling thread only
+  static const std::size_t PARALLEL_PARSE_MIN_BYTES = 1 << 20;
+
+  //===========================================================================
+
+  static inline bool
+  is_separator( const char c, const bool lisp_format )
+  {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v' ||
+      ( lisp_format && ( c == '(' || c == ')' ) );
+  }
+
+  //===========================================================================
+
+  static inline bool
+  is_exponent_marker( const char c, const bool lisp_format )
+  {
+    if( c == 'e' || c == 'E' ) {
+      return true;
+    }
+    return lisp_format && 
+      ( c == 'd' || c == 'D' || c == 'f' || c == 'F' ||
+	c == 's' || c == 'S' || c == 'l' || c == 'L' );
+  }
+
+  //===========================================================================
+
+  // Description:
+  // The "C" locale, so the slow path does not depend on the global
+  // locale (created once, never freed)
+  static locale_t
+  c_locale()
+  {
+    static const locale_t locale = newlocale( LC_ALL_MASK, "C", (locale_t)0 );
+    return locale;
+  }
+
+  //===========================================================================
+
+  // Description:
+  // Full precision (correctly rounded) parse of a number token, used
+  // when the fast path cannot guarantee a correctly rounded result
+  // (e.g. the 17 significant digits of a round trip printed double).
+  // The token has already been checked to be a decimal number, so
+  // this only copies it (with a C exponent marker) into a stack buffer
+  // for strtod_l; only tokens longer than the buffer allocate
+  static bool
+  parse_double_slow( const char* begin, 
+		     const char* end,
+		     const bool lisp_format,
+		     double& value )
   {
+    const std::size_t length = end - begin;
+    char stack_buffer[ 128 ];
+    std::vector<char> heap_buffer;
+    char* token = stack_buffer;
+    if( length >= sizeof( stack_buffer ) ) {
+      heap_buffer.resize( length + 1 );
+      token = &heap_buffer[0];
+    }
+    for( std::size_t i = 0; i < length; ++i ) {
+      token[i] = is_exponent_marker( begin[i], lisp_format ) ? 'e' : begin[i];
+    }
+    token[ length ] = '\0';
+
+    char* parsed_end;
+    value = strtod_l( token, &parsed_end, c_locale() );
+    return parsed_end == token + length;
+  }
+
+  //===========================================================================
+
+  // Description:
+  // Parses the number token [begin,end) into value, returning false
+  // if it is not a number. 
+  // Numbers whose decimal mantissa fits in 53 bits with a power of ten
+  // of at most 22 are exactly representable operands, so a single
+  // multiply/divide is correctly rounded; anything else goes through
+  // parse_double_slow
+  static bool
+  parse_double( const char* begin,
+		const char* end,
+		const bool lisp_format,
+		double& value )
+  {
+    static const double powers_of_ten[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    const char* p = begin;
+    bool negative = false;
+    if( p != end && ( *p == '-' || *p == '+' ) ) {
+      negative = ( *p == '-' );
+      ++p;
+    }
+
+    // mantissa digits
+    uint64_t mantissa = 0;
+    int num_digits = 0;
+    int exponent = 0;
+    bool any_digits = false;
+    for( ; p != end && *p >= '0' && *p <= '9'; ++p ) {
+      any_digits = true;
+      if( mantissa == 0 && *p == '0' ) {
+	continue;
+      }
+      if( num_digits < 19 ) {
+	mantissa = mantissa * 10 + ( *p - '0' );
+      } else {
+	++exponent;
+      }
+      ++num_digits;
+    }
+    if( p != end && *p == '.' ) {
+      ++p;
+      for( ; p != end && *p >= '0' && *p <= '9'; ++p ) {
+	any_digits = true;
+	if( mantissa == 0 && *p == '0' ) {
+	  --exponent;
+	  continue;
+	}
+	if( num_digits < 19 ) {
+	  mantissa = mantissa * 10 + ( *p - '0' );
+	  --exponent;
+	}
+	++num_digits;
+      }
+    }
+    if( !any_digits ) {
+      return false;
+    }
+
+    // exponent
+    if( p != end && is_exponent_marker( *p, lisp_format ) ) {
+      ++p;
+      bool negative_exponent = false;
+      if( p != end && ( *p == '-' || *p == '+' ) ) {
+	negative_exponent = ( *p == '-' );
+	++p;
+      }
+      if( p == end || *p < '0' || *p > '9' ) {
+	return false;
+      }
+      int e = 0;
+      for( ; p != end && *p >= '0' && *p <= '9'; ++p ) {
+	if( e < 100000 ) {
+	  e = e * 10 + ( *p - '0' );
+	}
+      }
+      exponent += negative_exponent ? -e : e;
+    }
+    if( p != end ) {
+      return false;
+    }
 
+    // fast exact path
+    if( num_digits <= 19 &&
+	mantissa <= ( (uint64_t)1 << 53 ) &&
+	exponent >= -22 && exponent <= 22 ) {
+      double v = (double)mantissa;
+      if( exponent < 0 ) {
+	v /= powers_of_ten[ -exponent ];
+      } else {
+	v *= powers_of_ten[ exponent ];
+      }
+      value = negative ? -v : v;
+      return true;
+    }
+
+    return parse_double_slow( begin, end, lisp_format, value );
+  }
+
+  //===========================================================================
+
+  // Description:
+  // Parses a single line [begin,end) into its coordinates.
+  // Returns false if any token is not a number
+  static bool
+  parse_ssv_line( const char* begin,
+		  const char* end,
+		  const bool lisp_format,
+		  std::vector<double>& data )
+  {
+    data.clear();
+    const char* p = begin;
+    while( true ) {
+      while( p != end && is_separator( *p, lisp_format ) ) {
+	++p;
+      }
+      if( p == end ) {
+	return true;
+      }
+      const char* token_end = p;
+      while( token_end != end && !is_separator( *token_end, lisp_format ) ) {
+	++token_end;
+      }
+      double value;
+      if( !parse_double( p, token_end, lisp_format, value ) ) {
+	return false;
+      }
+      data.push_back( value );
+      p = token_end;
+    }
+  }
+
+  //===========================================================================
+
+  // Description:
+  // The result of parsing one chunk of the input
+  struct ssv_chunk_t
+  {
+    const char* begin;
+    const char* end;
     std::vector<nd_point_t> points;
-  
-    // We assume that there is exactly one point per line (or empty lines)
-    std::string line;
-    while( std::getline( is, line ) ) {
-
-      // read the data s a vector of doubles
-      std::vector<double> data;
-      double temp;
-      std::string stemp;
-      std::istringstream line_stream( line );
-      while( line_stream >> stemp ) {
-	std::istringstream iss;
-	if( lisp_format ) {
-	  iss.str( stemp.substr(0,stemp.size() - 2) );
-	} else {
-	  iss.str( stemp );
+    std::size_t num_lines;
+    std::vector<std::size_t> malformed_lines; // 0-based, within chunk
+  };
+
+  //===========================================================================
+
+  static void
+  parse_ssv_chunks( std::vector<ssv_chunk_t>& chunks,
+		    const bool lisp_format,
+		    const std::size_t chunk_begin,
+		    const std::size_t chunk_end )
+  {
+    std::vector<double> data;
+    for( std::size_t c = chunk_begin; c < chunk_end; ++c ) {
+      ssv_chunk_t& chunk = chunks[ c ];
+      chunk.num_lines = 0;
+      const char* line = chunk.begin;
+      while( line != chunk.end ) {
+	const char* line_end = std::find( line, chunk.end, '\n' );
+	if( !parse_ssv_line( line, line_end, lisp_format, data ) ) {
+	  chunk.malformed_lines.push_back( chunk.num_lines );
+	} else if( !data.empty() ) {
+	  chunk.points.push_back( point( data ) );
+	  if( VERBOSE ) {
+	    std::cout << "..parsed " << data.size() << "-dim point" << std::endl;
+	  }
 	}
-	if( iss >> temp && data.size() < 2 ) {
-	  data.push_back( temp );
+	++chunk.num_lines;
+	line = ( line_end == chunk.end ) ? line_end : line_end + 1;
+      }
+    }
+  }
+
+  //===========================================================================
+
+  std::vector<nd_point_t> 
+  parse_points_from_ssv_stream( std::istream& is, 
+				bool lisp_format,
+				std::vector<std::size_t>& malformed_lines )
+  {
+    // read the whole stream into a single buffer
+    std::vector<char> buffer;
+    const std::size_t block = 1 << 20;
+    while( is ) {
+      std::size_t old_size = buffer.size();
+      buffer.resize( old_size + block );
+      is.read( &buffer[ old_size ], block );
+      buffer.resize( old_size + is.gcount() );
+    }
+    malformed_lines.clear();
+    if( buffer.empty() ) {
+      return std::vector<nd_point_t>();
+    }
+
+    // split into chunks at line boundaries
+    const char* data = &buffer[0];
+    const char* data_end = data + buffer.size();
+    std::size_t num_chunks = 1;
+    if( buffer.size() >= PARALLEL_PARSE_MIN_BYTES ) {
+      num_chunks = resolve_num_threads( 0 ) * 4;
+    }
+    std::vector<ssv_chunk_t> chunks;
+    const char* chunk_begin = data;
+    for( std::size_t c = 0; c < num_chunks && chunk_begin != data_end; ++c ) {
+      const char* chunk_end = data_end;
+      if( c + 1 < num_chunks ) {
+	std::size_t target = ( buffer.size() * ( c + 1 ) ) / num_chunks;
+	chunk_end = std::max( chunk_begin, data + target );
+	chunk_end = std::find( chunk_end, data_end, '\n' );
+	if( chunk_end != data_end ) {
+	  ++chunk_end;
 	}
       }
+      ssv_chunk_t chunk;
+      chunk.begin = chunk_begin;
+      chunk.end = chunk_end;
+      chunk.num_lines = 0;
+      chunks.push_back( chunk );
+      chunk_begin = chunk_end;
+    }
 
-      // add a new point structure from the data vector
-      points.push_back( point( data ) );
+    // parse the chunks in parallel
+    parallel_for( chunks.size(),
+		  boost::bind( &parse_ssv_chunks,
+			       boost::ref( chunks ),
+			       lisp_format,
+			       _1, _2 ) );
 
-      if( VERBOSE ) {
-	std::cout << "..parsed " << data.size() << "-dim point" << std::endl;
+    // stitch the results back together in order
+    std::size_t total = 0;
+    for( std::size_t c = 0; c < chunks.size(); ++c ) {
+      total += chunks[c].points.size();
+    }
+    std::vector<nd_point_t> points;
+    points.reserve( total );
+    std::size_t first_line = 1;
+    for( std::size_t c = 0; c < chunks.size(); ++c ) {
+      points.insert( points.end(), 
+		     chunks[c].points.begin(),
+		     chunks[c].points.end() );
+      for( std::size_t i = 0; i < chunks[c].malformed_lines.size(); ++i ) {
+	malformed_lines.push_back( first_line + chunks[c].malformed_lines[i] );
       }
+      first_line += chunks[c].num_lines;
     }
 
     return points;
   }
 
+  //===========================================================================
+
+  std::vector<nd_point_t> 
+  parse_points_from_ssv_stream( std::istream& is, bool lisp_format )
+  {
+    std::vector<std::size_t> malformed_lines;
+    std::vector<nd_point_t> points 
+      = parse_points_from_ssv_stream( is, lisp_format, malformed_lines );
+    if( !malformed_lines.empty() ) {
+      BOOST_THROW_EXCEPTION( malformed_ssv_line_exception()
+			     << boost::errinfo_at_line( (int)malformed_lines.front() ) );
+    }
+    return points;
+  }
+
   //===========================================================================
   //===========================================================================
   //===========================================================================
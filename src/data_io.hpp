@@ -4,18 +4,49 @@
 
 
 #include <math-core/types.hpp>
+#include <boost/exception/all.hpp>
+#include <stdexcept>
 #include <vector>
 #include <iosfwd>
+#include <cstddef>
 
 namespace point_process_experiment_core {
 
 
+  // Description:
+  // Exception thrown when a line of an SSV stream is not a list of
+  // numbers. Carries the (1-based) line number as boost::errinfo_at_line
+  struct malformed_ssv_line_exception : public virtual std::exception,
+					public virtual boost::exception
+  {
+  };
+
+
   // Description:
   // Given a SSV (Space Delimited Values) stream with point data,
   // returns a vector of ndpoint_t representing the point data.
+  // There is one point per line, with as many coordinates as there
+  // are numbers on the line. Blank lines are skipped.
+  // In lisp format numbers may use a lisp exponent marker (1.5d0) and
+  // parenthesis are treated as whitespace.
+  //
+  // Numbers are parsed in place without any locale, and large inputs
+  // are split into chunks which are parsed in parallel.
+  // Throws malformed_ssv_line_exception for the first line which is
+  // not a list of numbers.
   std::vector<math_core::nd_point_t> 
   parse_points_from_ssv_stream( std::istream& is, bool lisp_format=true );
 
+
+  // Description:
+  // As parse_points_from_ssv_stream but instead of throwing, the
+  // malformed lines are skipped and their (1-based) line numbers are
+  // returned in malformed_lines.
+  std::vector<math_core::nd_point_t> 
+  parse_points_from_ssv_stream( std::istream& is, 
+				bool lisp_format,
+				std::vector<std::size_t>& malformed_lines );
+
 }
 
 
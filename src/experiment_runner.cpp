@@ -1,10 +1,21 @@
 
 #include "experiment_runner.hpp"
 #include "experiment_utils.hpp"
+#include "parallel.hpp"
+#include "geometry.hpp"
 #include <object-search.common/context.hpp>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <map>
+#include <set>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
 #include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
+#include <boost/exception/errinfo_file_name.hpp>
 
 
 
@@ -16,6 +27,31 @@ using namespace boost::filesystem;
 namespace point_process_experiment_core {
 
 
+  //====================================================================
+
+  // Description:
+  // Returns the initial window for a world window given the
+  // fraction and whether it should be centered
+  static nd_aabox_t
+  initial_window_for
+  ( const nd_aabox_t& world_window,
+    const double& initial_window_fraction,
+    const bool initial_window_is_centered )
+  {
+    // get the initial, window
+    nd_aabox_t initial_window = 
+      aabox( world_window.start, 
+	     world_window.start + ( world_window.end - world_window.start ) * initial_window_fraction );
+
+    // shift the window to be centered
+    if( initial_window_is_centered ) {
+      nd_vector_t shift = 0.5 * ( world_window.end - initial_window.end );
+      initial_window = aabox( initial_window.start + shift,
+			      initial_window.end + shift );
+    }
+    return initial_window;
+  }
+
   //====================================================================
 
   std::vector<marked_grid_cell_t>
@@ -27,68 +63,400 @@ namespace point_process_experiment_core {
     const double& initial_window_fraction,
     const bool initial_window_is_centered,
     const double& fraction_truth_to_find,
-    const std::string& experiment_id ) 
+    const std::string& experiment_id,
+    const trace_level_t verbose_trace_level,
+    const std::size_t trace_sample_period,
+    const bool resume ) 
+  {
+    experiment_configuration_t configuration;
+    configuration.world = world;
+    configuration.model = model;
+    configuration.planner = planner_id;
+    configuration.add_empty_regions = add_empty_regions;
+    configuration.initial_window_fraction = initial_window_fraction;
+    configuration.initial_window_is_centered = initial_window_is_centered;
+    configuration.fraction_truth_to_find = fraction_truth_to_find;
+    configuration.experiment_id = experiment_id;
+    configuration.verbose_trace_level = verbose_trace_level;
+    configuration.trace_sample_period = trace_sample_period;
+    configuration.resume = resume;
+    return run_experiment( configuration );
+  }
+
+  //====================================================================
+
+  std::vector<marked_grid_cell_t>
+  run_experiment
+  ( const experiment_configuration_t& configuration )
   {
     // push the experiment id as a context
-    p2l::common::push_context( p2l::common::context_t( experiment_id ) );
-    
-    // get the wanted world points and window
-    std::vector< nd_point_t > ground_truth = groundtruth_for_world( world );
-    nd_aabox_t world_window = window_for_world( world );
+    p2l::common::push_context( p2l::common::context_t( configuration.experiment_id ) );
+
+    path p = path(p2l::common::context_filename( "planner.meta" ));
+    std::cout << "context filename are in: " << p2l::common::context_filename( "<filename>") << std::endl;
+    return run_experiment_in_directory( configuration,
+					p.parent_path().string(),
+					std::cout );
+  }
+
+  //====================================================================
+
+  std::vector<marked_grid_cell_t>
+  run_experiment_in_directory
+  ( const experiment_configuration_t& configuration,
+    const std::string& output_directory,
+    std::ostream& out_progress )
+  {
+    // get the wanted world points and window (for the replicate's
+    // seed if it is a seeded world)
+    boost::shared_ptr<const world_data_t> world
+      = world_data_for_world( configuration.world,
+			      configuration.replicate_seed );
+    const std::vector< nd_point_t >& ground_truth = world->groundtruth;
+    const nd_aabox_t& world_window = world->window;
     
     // build up the point process model
     boost::shared_ptr< mcmc_point_process_t > planner_process 
-      = get_model_by_id( model, world_window, ground_truth );
+      = get_model_by_id( configuration.model, world_window, ground_truth );
     
     // build up the planner
     boost::shared_ptr<grid_planner_t> planner 
-      = get_planner_by_id( planner_id, planner_process  );
+      = get_planner_by_id( configuration.planner, planner_process  );
     
     // get the initial, window
     nd_aabox_t initial_window = 
-      aabox( world_window.start, 
-	     world_window.start + ( world_window.end - world_window.start ) * initial_window_fraction );
-
-    // shift the window to be centered
-    if( initial_window_is_centered ) {
-      nd_vector_t shift = 0.5 * ( world_window.end - initial_window.end );
-      initial_window = aabox( initial_window.start + shift,
-			      initial_window.end + shift );
-    }
+      initial_window_for( world_window,
+			  configuration.initial_window_fraction,
+			  configuration.initial_window_is_centered );
     
-    // seed the planner
+    // seed the planner (timing the setup)
+    phase_timings_t setup_timings;
+    stopwatch_t setup_watch;
     initial_window =
       setup_planner_with_initial_observations( planner,
-					       add_empty_regions,
+					       configuration.add_empty_regions,
 					       initial_window,
-					       ground_truth );
+					       ground_truth,
+					       &setup_timings );
+    double setup_seconds = setup_watch.elapsed();
     
-    // create the meta and trace files
-    std::string temp;
-    path p;
-    p = path(p2l::common::context_filename( "planner.meta" ));
-    create_directories( p.parent_path() );
-    std::ofstream out_meta( p2l::common::context_filename( "planner.meta" ) );
-    std::ofstream out_trace( p2l::common::context_filename( "planner.trace" ) );
-    std::ofstream out_verbose_trace( p2l::common::context_filename( "planner.verbose-trace" ) );
-    std::cout << "context filename are in: " << p2l::common::context_filename( "<filename>") << std::endl;
+    // create the output directory
+    path dir( output_directory );
+    create_directories( dir );
+
+    // when resuming, read the iterations of the earlier run (every
+    // complete record of its binary trace) before anything is rewritten
+    std::vector<trace_record_t> replayed;
+    path binary_trace_path = dir / "planner.trace.bin";
+    if( configuration.resume && exists( binary_trace_path ) ) {
+      std::ifstream in_binary_trace( binary_trace_path.string().c_str(),
+				     std::ios::binary );
+      replayed = read_binary_trace_records( in_binary_trace );
+    }
+    bool resuming = !replayed.empty();
+    if( configuration.resume && !resuming ) {
+      out_progress << "resume: no complete iterations in "
+		   << binary_trace_path.string() << ", starting over" << std::endl;
+    }
+
+    // bring the planner up to where the earlier run stopped
+    stopwatch_t replay_watch;
+    replay_trace_records( planner,
+			  configuration.add_empty_regions,
+			  replayed );
+    double replay_seconds = replay_watch.elapsed();
+
+    // create the meta and trace files. A resumed run adds to the meta
+    // and verbose trace, and rewrites the traces with just the
+    // replayed iterations (dropping anything after the last complete one)
+    std::ios::openmode append_if_resuming
+      = resuming ? ( std::ios::out | std::ios::app ) : std::ios::out;
+    std::ofstream out_meta( ( dir / "planner.meta" ).string().c_str(),
+			    append_if_resuming );
+    std::ofstream out_trace( ( dir / "planner.trace" ).string().c_str() );
+    std::ofstream out_verbose_trace;
+    if( configuration.verbose_trace_level != TRACE_OFF ) {
+      out_verbose_trace.open( ( dir / "planner.verbose-trace" ).string().c_str(),
+			      append_if_resuming );
+    }
+
+    // record the configuration of the experiment
+    if( !resuming ) {
+      out_meta << "experiment-id: " << configuration.experiment_id << std::endl;
+      out_meta << "world: " << configuration.world << std::endl;
+      out_meta << "model: " << configuration.model << std::endl;
+      out_meta << "planner: " << configuration.planner << std::endl;
+      out_meta << "add-empty-regions: " << configuration.add_empty_regions << std::endl;
+      out_meta << "initial-window-fraction: " << configuration.initial_window_fraction << std::endl;
+      out_meta << "initial-window-is-centered: " << configuration.initial_window_is_centered << std::endl;
+      out_meta << "fraction-truth-to-find: " << configuration.fraction_truth_to_find << std::endl;
+      out_meta << "replicate-seed: " << configuration.replicate_seed << std::endl;
+      out_meta << "cells-per-step: " << configuration.cells_per_step << std::endl;
+      out_meta << "defer-negative-updates: " << configuration.defer_negative_updates << std::endl;
+      out_meta << "max-deferred-negative-updates: " << configuration.max_deferred_negative_updates << std::endl;
+      out_meta << "max-deferred-seconds: " << configuration.max_deferred_seconds << std::endl;
+      out_meta << "mcmc-budget-scheduler: " << configuration.mcmc_budget_scheduler << std::endl;
+      out_meta << "max-iterations: " << configuration.max_iterations << std::endl;
+      out_meta << "max-visited-cells: " << configuration.max_visited_cells << std::endl;
+      out_meta << "max-seconds: " << configuration.max_seconds << std::endl;
+      out_meta << "max-mcmc-seconds: " << configuration.max_mcmc_seconds << std::endl;
+    }
+
+    // the cost of seeding the planner
+    out_meta << "setup-seconds: " << setup_seconds << std::endl;
+    setup_timings.write_totals( out_meta );
+
+    // the trace options and the optional binary trace
+    // (which resumable runs always write)
+    simulation_options_t options;
+    options.verbose_trace_level = configuration.verbose_trace_level;
+    options.trace_sample_period = configuration.trace_sample_period;
+    options.cells_per_step = configuration.cells_per_step;
+    options.defer_negative_updates = configuration.defer_negative_updates;
+    options.max_deferred_negative_updates = configuration.max_deferred_negative_updates;
+    options.max_deferred_seconds = configuration.max_deferred_seconds;
+    options.mcmc_budget_scheduler
+      = mcmc_budget_scheduler_from_string( configuration.mcmc_budget_scheduler );
+    options.max_iterations = configuration.max_iterations;
+    options.max_visited_cells = configuration.max_visited_cells;
+    options.max_seconds = configuration.max_seconds;
+    options.max_mcmc_seconds = configuration.max_mcmc_seconds;
+    options.should_stop = configuration.should_stop;
+    std::ofstream out_binary_trace;
+    if( configuration.write_binary_trace || configuration.resume ) {
+      out_binary_trace.open( binary_trace_path.string().c_str(),
+			     std::ios::binary );
+      options.out_binary_trace = &out_binary_trace;
+    }
+
+    // write back the replayed iterations and continue after them
+    std::vector<marked_grid_cell_t> trace;
+    if( resuming ) {
+      binary_trace_writer_t binary_trace( out_binary_trace );
+      for( size_t i = 0; i < replayed.size(); ++i ) {
+	write_text_trace_record( out_trace, replayed[ i ] );
+	binary_trace.write( replayed[ i ] );
+	trace.push_back( replayed[ i ].cell );
+      }
+      binary_trace.flush();
+      options.start_iteration = replayed.back().iteration + 1;
+      options.append_binary_trace = true;
+      out_meta << "resumed-at-iteration: " << options.start_iteration << std::endl;
+      out_meta << "replay-seconds: " << replay_seconds << std::endl;
+      if( out_verbose_trace.is_open() ) {
+	out_verbose_trace << "+RESUMED+ " << options.start_iteration << std::endl;
+      }
+    }
     
     // run the planner
-    std::vector<marked_grid_cell_t> trace =
+    std::vector<marked_grid_cell_t> new_trace =
       simulate_run_until_all_points_found( planner,
-					   add_empty_regions,
+					   configuration.add_empty_regions,
 					   initial_window,
-					   fraction_truth_to_find,
+					   configuration.fraction_truth_to_find,
 					   ground_truth,
 					   out_meta,
 					   out_trace,
-					   std::cout,
-					   out_verbose_trace);
+					   out_progress,
+					   out_verbose_trace,
+					   options );
+    trace.insert( trace.end(), new_trace.begin(), new_trace.end() );
 
     return trace;
   }
+
+  //====================================================================
+
+  // Description:
+  // Runs a single experiment of a sweep, storing the outcome
+  static void
+  run_sweep_job( const experiment_configuration_t& configuration,
+		 const std::string& output_directory,
+		 experiment_result_t& result )
+  {
+    result.configuration = configuration;
+    result.output_directory = output_directory;
+    try {
+      create_directories( path( output_directory ) );
+      std::ofstream out_progress( ( path( output_directory ) / "planner.progress" ).string().c_str() );
+      result.trace = run_experiment_in_directory( configuration,
+						  output_directory,
+						  out_progress );
+      result.succeeded = true;
+    } catch( std::exception& e ) {
+      result.succeeded = false;
+      result.error = e.what();
+    } catch( ... ) {
+      result.succeeded = false;
+      result.error = "unknown exception";
+    }
+  }
+
+  //====================================================================
+
+  // Description:
+  // True iff name is a single directory name, so a directory of that
+  // name is directly inside its parent and different names are
+  // different directories
+  static bool
+  is_plain_directory_name( const std::string& name )
+  {
+    return !name.empty() &&
+      name != "." && name != ".." &&
+      name.find_first_of( "/\\" ) == std::string::npos;
+  }
+
+  //====================================================================
+
+  std::vector<experiment_result_t>
+  run_experiment_sweep
+  ( const std::vector<experiment_configuration_t>& configurations,
+    const std::string& output_root,
+    const std::size_t num_threads )
+  {
+    // each experiment's directory, which must all differ or the
+    // experiments would overwrite each other's output
+    std::vector<std::string> directories( configurations.size() );
+    std::set<std::string> used;
+    for( std::size_t i = 0; i < configurations.size(); ++i ) {
+      std::string name = configurations[i].experiment_id;
+      if( name.empty() ) {
+	std::ostringstream oss;
+	oss << "experiment-" << i;
+	name = oss.str();
+      }
+      directories[i] = ( path( output_root ) / name ).string();
+      if( !is_plain_directory_name( name ) ) {
+	BOOST_THROW_EXCEPTION( std::domain_error( "A sweep experiment id must be a single directory name (no path separators, . or ..): " + name ) );
+      }
+      if( !used.insert( name ).second ) {
+	BOOST_THROW_EXCEPTION( id_already_used_exception()
+			       << boost::errinfo_file_name( directories[i] ) );
+      }
+    }
+
+    std::vector<experiment_result_t> results( configurations.size() );
+    worker_pool_t pool( num_threads );
+    for( std::size_t i = 0; i < configurations.size(); ++i ) {
+      pool.submit( boost::bind( &run_sweep_job,
+				boost::cref( configurations[i] ),
+				directories[i],
+				boost::ref( results[i] ) ) );
+    }
+    pool.wait();
+    return results;
+  }
   
 
+  //====================================================================
+
+  // Description:
+  // The entropy of a model's belief of where the points are, estimated
+  // from samples: each grid cell is occupied (has a sampled point) with
+  // the fraction of samples in which it was, and the entropy is the sum
+  // of these per-cell (binary) occupancy entropies, in nats.
+  // Cells never occupied in any sample add nothing.
+  static double
+  occupancy_entropy( const boost::shared_ptr<mcmc_point_process_t>& process,
+		     const marked_grid_t<bool>& grid,
+		     const std::size_t num_samples )
+  {
+    std::map< std::vector<int>, std::size_t > occupied_count;
+    for( std::size_t s = 0; s < num_samples; ++s ) {
+      std::vector<nd_point_t> sample = process->sample_and_step();
+      std::set< std::vector<int> > occupied;
+      for( std::size_t i = 0; i < sample.size(); ++i ) {
+	occupied.insert( grid.cell( sample[i] ).coordinate );
+      }
+      for( std::set< std::vector<int> >::const_iterator it = occupied.begin();
+	   it != occupied.end(); ++it ) {
+	++occupied_count[ *it ];
+      }
+    }
+
+    double entropy = 0;
+    for( std::map< std::vector<int>, std::size_t >::const_iterator it = occupied_count.begin();
+	 it != occupied_count.end(); ++it ) {
+      double p = (double)it->second / num_samples;
+      if( p > 0 && p < 1 ) {
+	entropy -= p * std::log( p ) + ( 1 - p ) * std::log( 1 - p );
+      }
+    }
+    return entropy;
+  }
+
+  //====================================================================
+
+  // Description:
+  // The stream of the seed which the permutations of a permutation
+  // entropy trace are split from (one child stream per permutation)
+  static const uint64_t PERMUTATION_RNG_STREAM = 1;
+
+  //====================================================================
+
+  // Description:
+  // One permutation of a permutation entropy trace: the found cells
+  // in a random order (from its own random stream) replayed through
+  // its own fresh model
+  struct entropy_permutation_job_t
+  {
+    std::string model;
+    boost::shared_ptr<const world_data_t> world;
+    const marked_grid_t<bool>* grid;
+    const point_index_t* ground_truth_index;
+    const std::vector<marked_grid_cell_t>* cells;
+    bool add_empty_regions;
+    unsigned long mcmc_iterations;
+    std::size_t entropy_samples;
+    unsigned long seed;
+    std::size_t permutation;
+    std::string filename;
+
+    void run() const;
+  };
+
+  //====================================================================
+
+  void
+  entropy_permutation_job_t::run() const
+  {
+    // this permutation's order of the cells
+    rng_stream_t rng = rng_stream_t( seed, PERMUTATION_RNG_STREAM ).split( permutation );
+    std::vector<marked_grid_cell_t> order = *cells;
+    std::shuffle( order.begin(), order.end(), rng );
+
+    // a fresh model for this permutation only
+    boost::shared_ptr<mcmc_point_process_t> process
+      = get_model_by_id( model, world->window, world->groundtruth );
+
+    // stream out the entropy after each observation
+    std::ofstream out( filename.c_str() );
+    out << "# step cell #points entropy" << std::endl;
+    out << "-1 - 0 " << occupancy_entropy( process, *grid, entropy_samples ) << std::endl;
+    for( std::size_t i = 0; i < order.size(); ++i ) {
+      nd_aabox_t region = grid->region( order[i] );
+      std::vector<nd_point_t> points
+	= ground_truth_index->points_inside( region );
+      if( points.empty() ) {
+	process->add_negative_observation( region );
+      } else {
+	if( add_empty_regions ) {
+	  std::vector<nd_aabox_t> empty_regions
+	    = compute_empty_regions( points, region );
+	  for( std::size_t j = 0; j < empty_regions.size(); ++j ) {
+	    process->add_negative_observation( empty_regions[j] );
+	  }
+	}
+	process->add_observations( points );
+      }
+      process->mcmc( mcmc_iterations );
+      out << i << " " 
+	  << order[i] << " " 
+	  << points.size() << " "
+	  << occupancy_entropy( process, *grid, entropy_samples ) << std::endl;
+    }
+  }
+
   //====================================================================
 
   void
@@ -96,56 +464,69 @@ namespace point_process_experiment_core {
   ( const std::string& world,
     const std::string& model,
     const std::string& planner_id,
-    const std::string& experiment_id )
+    const std::string& experiment_id,
+    const std::size_t num_permutations,
+    const std::size_t num_threads,
+    const std::size_t entropy_samples,
+    const unsigned long seed )
   {
 
-    // // push the experiment id as a context
-    // p2l::common::push_context( p2l::common::context_t( experiment_id ) );
-    
-    // // get the wanted world points and window
-    // std::vector< nd_point_t > ground_truth = groundtruth_for_world( world );
-    // nd_aabox_t world_window = window_for_world( world );
-    
-    // // build up the point process model
-    // boost::shared_ptr< mcmc_point_process_t > planner_process 
-    //   = get_model_by_id( model, world_window, ground_truth );
-    
-    // // build up the planner
-    // boost::shared_ptr<grid_planner_t> planner 
-    //   = get_planner_by_id( planner_id, planner_process  );
-
-    // // create the meta and trace files
-    // std::ofstream out_meta( p2l::common::context_filename( "planner.meta" ) );
-    // std::ofstream out_trace( p2l::common::context_filename( "planner.trace" ) );
-    // std::ofstream out_verbose_trace( p2l::common::context_filename( "planner.verbose-trace" ) );
-    // std::cout << "context filename are in: " << p2l::common::context_filename( "<filename>") << std::endl;
-    
-    
-    // // run the planner to get first permutation of observations
-    // bool add_empty_regions = true;
-    // nd_aabox_t initial_window;
-    // double fraction_truth_to_find = 1.0;
-    // std::vector<marked_grid_cell_t> trace =
-    //   simulate_run_until_all_points_found( planner,
-    // 					   add_empty_regions,
-    // 					   initial_window,
-    // 					   fraction_truth_to_find,
-    // 					   ground_truth,
-    // 					   out_meta,
-    // 					   out_trace,
-    // 					   std::cout,
-    // 					   out_verbose_trace);
-
-
-    // // Ok, now we will run through the permutations of the 
-    // // observations
-    // std::vector<double> entropies
-    //   = calculate_entropy_from_fixed_observation_sequence
-    //   ( world,
-    // 	model,
-    // 	planner_id,
-    // 	random_permutation( trace ) );
-    
+    // push the experiment id as a context
+    p2l::common::push_context( p2l::common::context_t( experiment_id ) );
+    path dir = path( p2l::common::context_filename( "planner.meta" ) ).parent_path();
+    std::cout << "context filename are in: " << p2l::common::context_filename( "<filename>") << std::endl;
+
+    // run the planner to get the first permutation of observations
+    experiment_configuration_t configuration;
+    configuration.world = world;
+    configuration.model = model;
+    configuration.planner = planner_id;
+    configuration.experiment_id = experiment_id;
+    std::vector<marked_grid_cell_t> trace
+      = run_experiment_in_directory( configuration,
+				     dir.string(),
+				     std::cout );
+
+    // the grid and mcmc steps per observation of the planner
+    boost::shared_ptr<const world_data_t> world_data
+      = world_data_for_world( world );
+    boost::shared_ptr<mcmc_point_process_t> planner_process
+      = get_model_by_id( model, world_data->window, world_data->groundtruth );
+    boost::shared_ptr<grid_planner_t> planner 
+      = get_planner_by_id( planner_id, planner_process );
+    marked_grid_t<bool> grid = planner->visited_grid();
+    point_index_t ground_truth_index
+      = index_points_by_grid_cells( grid, world_data->groundtruth );
+
+    std::ofstream out_meta( ( dir / "permutation-entropy.meta" ).string().c_str() );
+    out_meta << "num-permutations: " << num_permutations << std::endl;
+    out_meta << "entropy-samples: " << entropy_samples << std::endl;
+    out_meta << "seed: " << seed << std::endl;
+    out_meta << "num-cells: " << trace.size() << std::endl;
+
+    // Ok, now we will run through the permutations of the 
+    // observations, each on its own with its own model
+    std::vector<entropy_permutation_job_t> jobs( num_permutations );
+    for( std::size_t i = 0; i < num_permutations; ++i ) {
+      std::ostringstream name;
+      name << "permutation-" << i << ".entropy";
+      jobs[i].model = model;
+      jobs[i].world = world_data;
+      jobs[i].grid = &grid;
+      jobs[i].ground_truth_index = &ground_truth_index;
+      jobs[i].cells = &trace;
+      jobs[i].add_empty_regions = configuration.add_empty_regions;
+      jobs[i].mcmc_iterations = (unsigned long)planner->get_grid_planner_parameters().update_model_mcmc_iterations;
+      jobs[i].entropy_samples = entropy_samples;
+      jobs[i].seed = seed;
+      jobs[i].permutation = i;
+      jobs[i].filename = ( dir / name.str() ).string();
+    }
+    worker_pool_t pool( num_threads );
+    for( std::size_t i = 0; i < jobs.size(); ++i ) {
+      pool.submit( boost::bind( &entropy_permutation_job_t::run, &jobs[i] ) );
+    }
+    pool.wait();
   }
 
 
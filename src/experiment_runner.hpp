@@ -4,14 +4,118 @@
 
 #include <string>
 #include <vector>
+#include <iosfwd>
 #include <point-process-core/marked_grid.hpp>
+#include <boost/function.hpp>
+#include "experiment_utils.hpp"
 
 namespace point_process_experiment_core {
 
 
+  // Description:
+  // The full configuration of a single experiment run
+  // (what run_experiment takes as arguments)
+  struct experiment_configuration_t
+  {
+    std::string world;
+    std::string model;
+    std::string planner;
+    bool add_empty_regions;
+    double initial_window_fraction;
+    bool initial_window_is_centered;
+    double fraction_truth_to_find;
+
+    // the seed of a seeded world's ground truth (see
+    // register_seeded_world), so replicates running in parallel each
+    // get their own reproducible world
+    unsigned long replicate_seed;
+    std::string experiment_id;
+
+    // also write planner.trace.bin (binary trace, see trace_io.hpp).
+    // On by default since it is what resume continues from, so any
+    // run which dies can be resumed
+    bool write_binary_trace;
+
+    // how much of planner.verbose-trace to write (see trace_level_t).
+    // With TRACE_OFF the file is not created
+    trace_level_t verbose_trace_level;
+    std::size_t trace_sample_period;
+
+    // continue an earlier run in the same directory from its
+    // planner.trace.bin, if it has one, rather than starting over.
+    // Resumable runs always write planner.trace.bin
+    bool resume;
+
+    // cells chosen per planning step, with one model update per step
+    // (see simulation_options_t::cells_per_step)
+    std::size_t cells_per_step;
+
+    // defer the model updates of negative observations
+    // (see simulation_options_t::defer_negative_updates)
+    bool defer_negative_updates;
+    std::size_t max_deferred_negative_updates;
+    double max_deferred_seconds;
+
+    // the mcmc budget scheduler for the run, as a description for
+    // mcmc_budget_scheduler_from_string (empty for the planner's fixed
+    // budget)
+    std::string mcmc_budget_scheduler;
+
+    // run budgets, 0 is no limit (see simulation_options_t). Why the
+    // run stopped is written to planner.meta
+    std::size_t max_iterations;
+    std::size_t max_visited_cells;
+    double max_seconds;
+    double max_mcmc_seconds;
+
+    // cooperative cancellation, checked before every planning step
+    // (see simulation_options_t::should_stop)
+    boost::function<bool ()> should_stop;
+
+    experiment_configuration_t()
+      : add_empty_regions( true ),
+	initial_window_fraction( 0.1 ),
+	initial_window_is_centered( false ),
+	fraction_truth_to_find( 1.0 ),
+	replicate_seed( 0 ),
+	write_binary_trace( true ),
+	verbose_trace_level( TRACE_FULL ),
+	trace_sample_period( 1 ),
+	resume( false ),
+	cells_per_step( 1 ),
+	defer_negative_updates( false ),
+	max_deferred_negative_updates( 0 ),
+	max_deferred_seconds( 0 ),
+	max_iterations( 0 ),
+	max_visited_cells( 0 ),
+	max_seconds( 0 ),
+	max_mcmc_seconds( 0 )
+    {}
+  };
+
+  // Description:
+  // The outcome of one experiment of a sweep
+  struct experiment_result_t
+  {
+    experiment_configuration_t configuration;
+    std::string output_directory;
+    bool succeeded;
+    std::string error;
+    std::vector<point_process_core::marked_grid_cell_t> trace;
+
+    experiment_result_t() : succeeded( false ) {}
+  };
+
+
   // Description:
   // Run an experiment.
   // With a given world,planner,and model.
+  // The verbose trace level (and sample period for TRACE_SAMPLED)
+  // control how much of planner.verbose-trace is produced.
+  // With resume, an earlier run of the same experiment which did not
+  // finish is continued (see experiment_configuration_t::resume) from
+  // the planner.trace.bin in its context directory, which every run
+  // writes. Without that file the experiment starts over.
   std::vector<point_process_core::marked_grid_cell_t>
   run_experiment
   ( const std::string& world,
@@ -21,7 +125,58 @@ namespace point_process_experiment_core {
     const double& initial_window_fraction,
     const bool initial_window_is_centered,
     const double& fraction_truth_to_find,
-    const std::string& experiment_id );
+    const std::string& experiment_id,
+    const trace_level_t verbose_trace_level = TRACE_FULL,
+    const std::size_t trace_sample_period = 1,
+    const bool resume = false );
+
+
+  // Description:
+  // Run an experiment with the full configuration (including the run
+  // budgets and should_stop, which the overload above leaves unset),
+  // writing into the context directory of its experiment_id as
+  // the overload above does.
+  std::vector<point_process_core::marked_grid_cell_t>
+  run_experiment
+  ( const experiment_configuration_t& configuration );
+
+
+  // Description:
+  // Run an experiment, writing all of the output files 
+  // (planner.meta, planner.trace, ...) into the given directory 
+  // (created if needed) and progress to the given stream.
+  // If resuming, the iterations in the directory's planner.trace.bin
+  // are replayed into the freshly seeded planner in one batch (see
+  // replay_trace_records) and the run continues from there.
+  // This does not use the global context, so several experiments may
+  // run at once in different threads.
+  std::vector<point_process_core::marked_grid_cell_t>
+  run_experiment_in_directory
+  ( const experiment_configuration_t& configuration,
+    const std::string& output_directory,
+    std::ostream& out_progress );
+
+
+  // Description:
+  // Runs all of the given experiments on a pool of num_threads
+  // worker threads (0 means one per core).
+  // Each experiment writes into its own directory under output_root,
+  // named by its experiment_id (or "experiment-<index>" if it has none),
+  // with its progress going to planner.progress in that directory.
+  // Before running anything, throws std::domain_error if an id is not
+  // a single directory name (has a path separator, or is . or ..) and
+  // id_already_used_exception (with the directory as its
+  // boost::errinfo_file_name) if two experiments would share a
+  // directory, so give replicates (e.g. differing only by
+  // replicate_seed) distinct ids.
+  // A failing experiment does not stop the sweep, its result records
+  // the error instead.
+  // Returns the results in the same order as the configurations.
+  std::vector<experiment_result_t>
+  run_experiment_sweep
+  ( const std::vector<experiment_configuration_t>& configurations,
+    const std::string& output_root,
+    const std::size_t num_threads = 0 );
 
   //=======================================================================
 
@@ -30,12 +185,23 @@ namespace point_process_experiment_core {
   // We then replay different orderings of the found
   // locations, and compute the entropy of the system after each
   // observation
+  //
+  // Each of the num_permutations random orderings (from its own random
+  // stream of the seed) is replayed through its own fresh model on a
+  // pool of num_threads workers (0 means one per core), and its entropy
+  // curve is streamed to permutation-<i>.entropy. The entropy is the
+  // grid cell occupancy entropy estimated from entropy_samples samples
+  // of the model.
   void
   run_permutation_entropy_trace
   ( const std::string& world,
     const std::string& model,
     const std::string& planner,
-    const std::string& experiment_id );
+    const std::string& experiment_id,
+    const std::size_t num_permutations = 10,
+    const std::size_t num_threads = 0,
+    const std::size_t entropy_samples = 100,
+    const unsigned long seed = 0 );
 
 
 
@@ -1,8 +1,19 @@
 
 #include "experiment_utils.hpp"
+#include "point_index.hpp"
+#include "geometry.hpp"
+#include "parallel.hpp"
+#include "trace_io.hpp"
+#include "trace_writer.hpp"
+#include "phase_timing.hpp"
+#include "mcmc_budget.hpp"
 #include <iostream>
 #include <algorithm>
 #include <math-core/io.hpp>
+#include <boost/bind.hpp>
+#include <boost/weak_ptr.hpp>
+#include <map>
+#include <mutex>
 
 #define VERBOSE false
 #define PRINT_PROGRESS true
@@ -15,74 +26,61 @@ namespace point_process_experiment_core {
 
   //==========================================================================
 
-  std::vector<nd_aabox_t>
-  compute_empty_regions( const std::vector<nd_point_t>& points,
-			 const nd_aabox_t& region,
-			 const double epsilon = 1e-7)
+  point_index_t
+  index_points_by_grid_cells( const marked_grid_t<bool>& grid,
+			      const std::vector<nd_point_t>& points )
   {
-    assert( region.start.n == 2 );
-    assert( region.start.n > 0 );
-    if( region.start.n != 2 ) {
-      throw std::domain_error( "Canno compute empty regions, only implemented 2D case!" );
-    }
-
-    // ok, first we need to sort the points by their x coordinate
-    // and another sorted by their y coordinates
-    int dim = region.start.n;
-    std::vector<nd_point_t> points_x( points );
-    std::sort( points_x.begin(),
-	       points_x.end(),
-	       &point_compare_x );
-    std::vector<nd_point_t> points_y( points );
-    std::sort( points_y.begin(),
-	       points_y.end(),
-	       &point_compare_y );
-  
-    // Now, create the x and y lines
-    std::vector< nd_point_t > x_line_ticks;
-    std::vector< nd_point_t > y_line_ticks;
-    x_line_ticks.push_back( region.start );
-    y_line_ticks.push_back( region.start );
-    for( size_t i = 0; i < points_x.size(); ++i ) {
-      nd_vector_t x_margin = ( epsilon * vector( axis_direction( dim, 0 ) ) );
-      x_line_ticks.push_back( points_x[i] + (-1.0 * x_margin) );
-      x_line_ticks.push_back( points_x[i] + x_margin );
-      nd_vector_t y_margin = ( epsilon * vector( axis_direction( dim, 1 ) ) );
-      y_line_ticks.push_back( points_y[i] + (-1.0 * y_margin) );
-      y_line_ticks.push_back( points_y[i] + y_margin );
-    }
-    x_line_ticks.push_back( region.end );
-    y_line_ticks.push_back( region.end );
-  
-    // create all sub regions given the lines and return those which do not
-    // have a point in them
+    // every cell has the same size, so the cell of the first point
+    // gives it without building all of the grid's cells (with no
+    // points the bucket size does not matter)
+    std::vector<double> bucket_size;
+    if( !points.empty() ) {
+      nd_aabox_t cell_region = grid.region( grid.cell( points[0] ) );
+      for( long d = 0; d < cell_region.start.n; ++d ) {
+	bucket_size.push_back( cell_region.end.coordinate[d] -
+			       cell_region.start.coordinate[d] );
+      }
+    }
+    return point_index_t( points, bucket_size );
+  }
+
+  //==========================================================================
+
+  // Description:
+  // What the setup needs to know about each of the initial cells.
+  // Filled in (independently per cell) by classify_initial_cells
+  struct initial_cell_t
+  {
+    bool negative;
     std::vector<nd_aabox_t> empty_regions;
-    for( size_t xi = 0; xi < x_line_ticks.size() - 1; ++xi ) {
-      nd_point_t xstart = x_line_ticks[xi];
-      nd_point_t xend = x_line_ticks[xi+1];
-      for( size_t yi = 0; yi < y_line_ticks.size() - 1; ++yi ) {
-	nd_point_t ystart = y_line_ticks[yi];
-	nd_point_t yend = y_line_ticks[yi+1];
-
-	nd_point_t start = point( xstart.coordinate[0],
-				  ystart.coordinate[1] );
-	nd_point_t end = point( xend.coordinate[0],
-				yend.coordinate[1] );
-	nd_aabox_t box = aabox( start, end );
-	bool empty = true;
-	for( size_t k = 0; k < points.size(); ++k ) {
-	  if( is_inside( points[k], box ) ) {
-	    empty = false;
-	    break;
-	  }
-	}
-	if( empty ) {
-	  empty_regions.push_back( box );
-	}
+  };
+
+  //==========================================================================
+
+  // Description:
+  // Classifies the initial cells in [begin,end) as negative (no ground
+  // truth inside) or partial, computing the empty regions of partial
+  // cells if wanted. Only touches its own cells' entries so chunks can
+  // run in parallel.
+  static void
+  classify_initial_cells( const marked_grid_t<bool>& grid,
+			  const std::vector<marked_grid_cell_t>& cells,
+			  const point_index_t& ground_truth_index,
+			  const bool add_empty_regions,
+			  std::vector<initial_cell_t>& classified,
+			  const size_t begin,
+			  const size_t end )
+  {
+    for( size_t i = begin; i < end; ++i ) {
+      nd_aabox_t region = grid.region( cells[ i ] );
+      std::vector<nd_point_t> points
+	= ground_truth_index.points_inside( region );
+      classified[ i ].negative = points.empty();
+      if( !points.empty() && add_empty_regions ) {
+	classified[ i ].empty_regions = compute_empty_regions( points,
+							       region );
       }
     }
-  
-    return empty_regions;
   }
 
   //==========================================================================
@@ -92,9 +90,13 @@ namespace point_process_experiment_core {
   ( boost::shared_ptr<grid_planner_t>& planner,
     bool add_empty_regions,
     const nd_aabox_t& initial_window,
-    const std::vector<nd_point_t>& ground_truth )
+    const std::vector<nd_point_t>& ground_truth,
+    phase_timings_t* timings )
   {
 
+    phase_timings_t setup_timings;
+    stopwatch_t watch;
+
     // grab the grid to use from hte planner (just as structure!)
     marked_grid_t<bool> grid = planner->visited_grid();
 
@@ -107,12 +109,17 @@ namespace point_process_experiment_core {
     // compute the actual window used (by hte grid resolution)
     nd_aabox_t actual_window = enclosing_window_for_cells( grid, cells );
 
+    // bucket the ground truth by grid cell in a single pass, so
+    // every cell lookup below only costs the points in that cell
+    point_index_t ground_truth_index
+      = index_points_by_grid_cells( grid, ground_truth );
+
     // grab the ground truth points inside of the window
     std::vector<nd_point_t> seen_points;
     if( !undefined(actual_window) ) {
-      seen_points = points_inside_window(actual_window,
-					 ground_truth);
+      seen_points = ground_truth_index.points_inside( actual_window );
     }
+    setup_timings.add( PHASE_SETUP_INDEX, watch.lap() );
 
     if( VERBOSE ) {
       std::cout << "-- #groundtruth: " << ground_truth.size() << std::endl;
@@ -123,6 +130,19 @@ namespace point_process_experiment_core {
       std::cout << "-- #total cells: " << grid.all_cells().size() << std::endl;
     }
 
+    // work out the negative and partial cells (and the empty regions
+    // of the partial cells) in parallel. Nothing here touches the
+    // planner, that is all done in one batch afterwards
+    std::vector<initial_cell_t> classified( cells.size() );
+    parallel_for( cells.size(),
+		  boost::bind( &classify_initial_cells,
+			       boost::cref( grid ),
+			       boost::cref( cells ),
+			       boost::cref( ground_truth_index ),
+			       add_empty_regions,
+			       boost::ref( classified ),
+			       _1, _2 ) );
+    setup_timings.add( PHASE_SETUP_CLASSIFY, watch.lap() );
 
     // Ok, since we are batch updating the planner, temporarily set the
     // update_model_mcmc_iterations to 0
@@ -132,68 +152,53 @@ namespace point_process_experiment_core {
     batch_params.update_model_mcmc_iterations = 0;
     planner->set_grid_planner_parameters( batch_params );
 
-
-    if( false ) {
-      for( size_t i = 0; i < seen_points.size(); ++i ) {
-	if( seen_points[i].n != 2 ) {
-	  std::cout << "!! seen_points[" << i << "].n = " << seen_points[i].n << std::endl;
-	} 
-      }
-      for( size_t i = 0; i < ground_truth.size(); ++i ) {
-	if( ground_truth[i].n != 2 ) {
-	  std::cout << "!! ground_truth[" << i << "].n = " << ground_truth[i].n << std::endl;
-	} 
-      }
-    }
-
     // store the last of the seen points to add at the very end
+    // (or, with no seen points, the last negative cell) so that it
+    // triggers the single model update for the batch
     std::vector<nd_point_t> last_seen_point;
-    last_seen_point.push_back( seen_points.back() );
-    seen_points.pop_back();
+    if( !seen_points.empty() ) {
+      last_seen_point.push_back( seen_points.back() );
+      seen_points.pop_back();
+    }
+    size_t last_negative_cell = cells.size();
+    if( last_seen_point.empty() ) {
+      for( size_t i = 0; i < cells.size(); ++i ) {
+	if( classified[ i ].negative ) {
+	  last_negative_cell = i;
+	}
+      }
+    }
   
     // now update the planner with the observations of the points
-    planner->add_observations( seen_points );
+    if( !seen_points.empty() ) {
+      planner->add_observations( seen_points );
+    }
 
     if( true && VERBOSE ) {
       std::cout << "-- adding negative regions" << std::endl;
     }
 
     // now add the fully negative cell regions
-    std::vector<marked_grid_cell_t> partial_cells;
+    size_t num_partial_cells = 0;
     for( size_t i = 0; i < cells.size(); ++i ) {
-      nd_aabox_t region = grid.region( cells[ i ] );
-      if( points_inside_window( region, ground_truth ).empty() ) {
-      
-	// this is a fully negative cell, so add it to the planner
+      if( !classified[ i ].negative ) {
+	++num_partial_cells;
+      } else if( i != last_negative_cell ) {
 	planner->add_negative_observation( cells[i] );
-      } else {
-    
-	// this is a partial cell (so some points inside)!
-	// store for future processing
-	partial_cells.push_back( cells[i] );
       }
     }
 
     if( true && VERBOSE && add_empty_regions) {
-      std::cout << "-- adding empty regions " << partial_cells.size() << std::endl;
+      std::cout << "-- adding empty regions " << num_partial_cells << std::endl;
     }
 
     // deal with partial cells, which have some obseved points in them.
     // We need to add the "emptyu space" around hte observed points so
     // that we get good inference
     if( add_empty_regions ) {
-      for( size_t i = 0; i < partial_cells.size(); ++i ) {
-	
-	// grab the points in the cell's region
-	nd_aabox_t region = grid.region( partial_cells[i] );
-	std::vector<nd_point_t> points = points_inside_window( region,
-							       ground_truth );
-	
-	// now compute the empty region of the cell
-	std::vector<nd_aabox_t> empty_regions = compute_empty_regions( points,
-								       region );
-	
-	// add the empty region to the planner
+      for( size_t i = 0; i < cells.size(); ++i ) {
+	const std::vector<nd_aabox_t>& empty_regions
+	  = classified[ i ].empty_regions;
 	for( size_t j = 0; j < empty_regions.size(); ++j ) {
 	  planner->add_empty_region( empty_regions[ j ] );
 	}
@@ -202,10 +207,16 @@ namespace point_process_experiment_core {
 
     // restore the grid planner params for non-batch use
     planner->set_grid_planner_parameters( old_params );
+    setup_timings.add( PHASE_SETUP_BATCH, watch.lap() );
 
     // force a *single* model update sequence of mcmc steps
     // for the entire batch of new observations
-    planner->add_observations( last_seen_point );
+    if( !last_seen_point.empty() ) {
+      planner->add_observations( last_seen_point );
+    } else if( last_negative_cell < cells.size() ) {
+      planner->add_negative_observation( cells[ last_negative_cell ] );
+    }
+    setup_timings.add( PHASE_SETUP_MODEL_UPDATE, watch.lap() );
 
 
     // mark all of the inital cells as visited
@@ -217,6 +228,9 @@ namespace point_process_experiment_core {
     planner->set_current_position( actual_window.start +
 				   ( 0.5 * (actual_window.end - actual_window.start) ) );
 
+    if( timings ) {
+      timings->add( setup_timings );
+    }
     
     // return the actual window used
     return actual_window;
@@ -237,9 +251,164 @@ namespace point_process_experiment_core {
     std::ostream& out_progress,
     std::ostream& out_verbose_trace )
   {
+    return simulate_run_until_all_points_found( planner,
+						add_empty_regions,
+						initial_window,
+						fraction_truth_to_find,
+						ground_truth,
+						out_meta,
+						out_trace,
+						out_progress,
+						out_verbose_trace,
+						simulation_options_t() );
+  }
+
+  //==========================================================================
+
+  // Description:
+  // Returns the ground truth points inside the region which have not
+  // been observed yet, marking them as observed
+  static std::vector<nd_point_t>
+  find_new_points( const std::vector<nd_point_t>& ground_truth,
+		   const point_index_t& ground_truth_index,
+		   std::vector<bool>& ground_truth_observed,
+		   const nd_aabox_t& region )
+  {
+    std::vector<nd_point_t> new_obs;
+    std::vector<std::size_t> inside_region
+      = ground_truth_index.indices_inside( region );
+    for( std::size_t i = 0; i < inside_region.size(); ++i ) {
+
+      // check if point (inside region) is not already part of process
+      if( !ground_truth_observed[ inside_region[i] ] ) {
+	new_obs.push_back( ground_truth[ inside_region[i] ] );
+	ground_truth_observed[ inside_region[i] ] = true;
+      }
+    }
+    return new_obs;
+  }
+
+  //==========================================================================
+
+  // Description:
+  // Adds the observation of the event's cell to the planner: a negative
+  // observation if there are no new points, otherwise the empty regions
+  // (if wanted) and then the points. If update_params is given, the
+  // planner parameters are set to it right before the update which
+  // triggers the model update (the end of a batch)
+  static void
+  apply_observation( boost::shared_ptr<grid_planner_t>& planner,
+		     const bool add_empty_regions,
+		     const std::vector<nd_point_t>& new_obs,
+		     const grid_planner_parameters_t* update_params,
+		     trace_event_t& event )
+  {
+    stopwatch_t watch;
+    if( new_obs.empty() ) {
+      if( update_params ) {
+	planner->set_grid_planner_parameters( *update_params );
+      }
+      planner->add_negative_observation( event.record.cell );
+      event.timings.add( PHASE_MODEL_UPDATE, watch.lap() );
+      event.negative = true;
+      return;
+    }
+
+    // now add negative regions for the places in the cell without points
+    if( add_empty_regions ) {
+      event.empty_regions = compute_empty_regions( new_obs, 
+						   event.record.region );
+      event.timings.add( PHASE_EMPTY_REGIONS, watch.lap() );
+      for( size_t i = 0; i < event.empty_regions.size(); ++i ) {
+	planner->add_empty_region( event.empty_regions[i] );
+      }
+      event.timings.add( PHASE_ADD_EMPTY_REGIONS, watch.lap() );
+    }
+
+    // and add teh actual observations 
+    // (make sure this is AFTER the empty regions)
+    if( update_params ) {
+      planner->set_grid_planner_parameters( *update_params );
+    }
+    planner->add_observations( new_obs );
+    event.timings.add( PHASE_MODEL_UPDATE, watch.lap() );
+    event.negative = false;
+  }
+
+  //==========================================================================
+
+  // Description:
+  // Decides how much of the event goes to the verbose trace and
+  // captures the planner information (including the model parameters!)
+  // if it is going to be written. This depends on the current planner
+  // state so has to be done by the planning thread.
+  static void
+  capture_planner_trace( const boost::shared_ptr<grid_planner_t>& planner,
+			 const simulation_options_t& options,
+			 trace_event_t& event )
+  {
+    event.verbose = ( options.verbose_trace_level != TRACE_OFF );
+    event.has_planner_trace = 
+      ( options.verbose_trace_level == TRACE_FULL ) ||
+      ( options.verbose_trace_level == TRACE_SAMPLED &&
+	event.record.iteration % std::max( options.trace_sample_period, (size_t)1 ) == 0 );
+    if( event.has_planner_trace ) {
+      stopwatch_t watch;
+      std::ostringstream planner_oss;
+      planner->print_shallow_trace( planner_oss );
+      event.planner_trace = planner_oss.str();
+      std::ostringstream model_oss;
+      planner->print_model_shallow_trace( model_oss );
+      event.model_trace = model_oss.str();
+      event.timings.add( PHASE_TRACE_CAPTURE, watch.lap() );
+    }
+  }
+
+  //==========================================================================
+
+  // Description:
+  // Returns why a run should stop before its next cell because it is
+  // out of one of its budgets (see simulation_options_t), or NULL
+  static const char*
+  run_budget_stop_reason( const simulation_options_t& options,
+			  const size_t iteration,
+			  const size_t num_visited_cells,
+			  const double seconds,
+			  const double mcmc_seconds )
+  {
+    if( options.max_iterations > 0 && iteration >= options.max_iterations ) {
+      return "max-iterations";
+    }
+    if( options.max_visited_cells > 0 && num_visited_cells >= options.max_visited_cells ) {
+      return "max-visited-cells";
+    }
+    if( options.max_seconds > 0 && seconds >= options.max_seconds ) {
+      return "max-seconds";
+    }
+    if( options.max_mcmc_seconds > 0 && mcmc_seconds >= options.max_mcmc_seconds ) {
+      return "max-mcmc-seconds";
+    }
+    return NULL;
+  }
+
+  //==========================================================================
+
+  std::vector<marked_grid_cell_t>
+  simulate_run_until_all_points_found
+  ( boost::shared_ptr<grid_planner_t>& planner,
+    bool add_empty_regions,
+    const nd_aabox_t& initial_window,
+    const double& fraction_truth_to_find,
+    const std::vector<nd_point_t>& ground_truth,
+    std::ostream& out_meta,
+    std::ostream& out_trace,
+    std::ostream& out_progress,
+    std::ostream& out_verbose_trace,
+    const simulation_options_t& options )
+  {
 
     // the iteration counter
-    size_t iteration = 0;
+    size_t iteration = options.start_iteration;
 
     // compute how many points we need to find to have found
     // the wanted fraction of the total points
@@ -254,179 +423,393 @@ namespace point_process_experiment_core {
       }
     }
 
+    // index the ground truth by the planner's grid cells once so that
+    // each step only looks at the points in the chosen cell
+    // (the grid structure never changes, so is only copied once)
+    const marked_grid_t<bool> grid = planner->visited_grid();
+    point_index_t ground_truth_index
+      = index_points_by_grid_cells( grid, ground_truth );
+
+    // keep track of which ground truth points are already part of the
+    // process (by ground truth index) and how many observations the
+    // planner has, so we never need to copy the planner's observations
+    // inside the loop
+    std::vector<bool> ground_truth_observed( ground_truth.size(), false );
+    size_t num_observed_points = 0;
+    {
+      std::vector<nd_point_t> obs = planner->observations();
+      num_observed_points = obs.size();
+      for( size_t i = 0; i < obs.size(); ++i ) {
+	std::vector<std::size_t> same
+	  = ground_truth_index.indices_inside( aabox( obs[i], obs[i] ) );
+	for( size_t k = 0; k < same.size(); ++k ) {
+	  if( ground_truth[ same[k] ] == obs[i] ) {
+	    ground_truth_observed[ same[k] ] = true;
+	  }
+	}
+      }
+    }
+
     if( true && PRINT_PROGRESS ) {
       (out_progress) << "Starting SIMULATION: " << std::endl;
       (out_progress) << "  Init Window: " << initial_window << std::endl;
-      (out_progress) << "  Init #points: " << planner->observations().size() << std::endl;
+      (out_progress) << "  Init #points: " << num_observed_points << std::endl;
       (out_progress) << "  Total Points: " << ground_truth.size() << std::endl;
       (out_progress) << "  Goal #points: " << goal_num_points_to_find << " (" << fraction_truth_to_find << ")" << std::endl;
     }
 
+    // the per-iteration phase timings go to the meta file (written by
+    // the trace writer along with the rest of the iteration's trace)
+    out_meta << "timing-units: seconds" << std::endl;
+    phase_timings_t run_timings;
+    stopwatch_t run_watch;
+
+    // the trace writer, which formats and writes the traces (on its own
+    // thread unless asked not to). It is closed (drained) on every exit
+    trace_writer_t trace_writer( out_trace,
+				 PRINT_PROGRESS ? &out_progress : NULL,
+				 out_verbose_trace,
+				 options.out_binary_trace,
+				 &out_meta,
+				 options.asynchronous_trace,
+				 1024,
+				 options.append_binary_trace );
+
     // the list of chosen cells
     std::vector<marked_grid_cell_t> chosen_cells;
-    std::vector<nd_aabox_t> chosen_regions;
-    std::vector< bool > chosen_region_negative;
+    size_t cells_per_step = std::max( options.cells_per_step, (size_t)1 );
+
+    // the negative observations added since the last model update
+    // (when deferring them) and the time since the first of them
+    size_t num_deferred_updates = 0;
+    stopwatch_t deferred_watch;
+
+    // the number of visited cells (including those of the initial
+    // window) for the visited cell budget
+    size_t num_visited_cells = 0;
+    if( options.max_visited_cells > 0 ) {
+      std::vector<marked_grid_cell_t> cells = grid.all_cells();
+      for( size_t i = 0; i < cells.size(); ++i ) {
+	boost::optional<bool> visited = grid( cells[i] );
+	if( visited && *visited ) {
+	  ++num_visited_cells;
+	}
+      }
+    }
+    const char* stop_reason = "goal-reached";
 
     // run the planner while we have no found the goal number of points
-    while( planner->observations().size() < goal_num_points_to_find ) {
-
-      // pint out the iteration number
-      out_verbose_trace << "+ITERATION+ " << iteration << std::endl;
+    // (and are within the run budgets)
+    while( num_observed_points < goal_num_points_to_find ) {
+
+      // stop at the step boundary if out of budget or cancelled
+      const char* budget_reason
+	= run_budget_stop_reason( options,
+				  iteration,
+				  num_visited_cells,
+				  run_watch.elapsed(),
+				  run_timings.seconds[ PHASE_MODEL_UPDATE ] );
+      if( !budget_reason && options.should_stop && options.should_stop() ) {
+	budget_reason = "cancelled";
+      }
+      if( budget_reason ) {
+	stop_reason = budget_reason;
+	break;
+      }
 
-      // plot out the planner
-      std::ostringstream plot_oss;
-      plot_oss << "iter-" << iteration << "-planner";
-      //planner->plot( plot_oss.str() );
-    
-      // Choose the next observation cell
-      marked_grid_cell_t next_cell = 
-	planner->choose_next_observation_cell();
-    
-      // Take any points inside the cell
-      // and add as observations
-      std::vector<nd_point_t> new_obs;
-      nd_aabox_t region = planner->visited_grid().region( next_cell );
-      std::vector<nd_point_t> obs = planner->observations();
-      for( std::size_t p_i = 0;
-	   p_i < ground_truth.size();
-	   ++p_i ) {
-
-	// check if point is inside region and not already part of process
-	nd_point_t point = ground_truth[ p_i ];
-	if( is_inside( point, region ) &&
-	    std::find( obs.begin(),
-		       obs.end(),
-		       point ) == obs.end() ) {
-	  new_obs.push_back( point );
+      // the planner's update parameters, the ones for this step's
+      // update (which may get a scheduled mcmc budget) and the same
+      // without any mcmc for the batch of observations of a step
+      grid_planner_parameters_t base_params
+	= planner->get_grid_planner_parameters();
+      grid_planner_parameters_t params = base_params;
+      grid_planner_parameters_t batch_params = base_params;
+      batch_params.update_model_mcmc_iterations = 0;
+
+      // Choose the cells of this step, taking any points inside each
+      // cell. The model is not updated until the whole step has been
+      // chosen, so all but the last cell are marked as visited right
+      // away for the planner not to choose them again
+      std::vector<trace_event_t> events;
+      std::vector< std::vector<nd_point_t> > new_obs;
+      size_t num_observed_before_step = num_observed_points;
+      while( events.size() < cells_per_step &&
+	     num_observed_points < goal_num_points_to_find &&
+	     ( events.empty() ||
+	       !run_budget_stop_reason( options,
+					iteration + events.size(),
+					num_visited_cells + events.size(),
+					run_watch.elapsed(),
+					run_timings.seconds[ PHASE_MODEL_UPDATE ] ) ) ) {
+	if( !events.empty() ) {
+	  planner->add_visited_cell( events.back().record.cell );
 	}
+	events.push_back( trace_event_t() );
+	trace_event_t& event = events.back();
+	stopwatch_t watch;
+	event.record.cell = planner->choose_next_observation_cell();
+	event.timings.add( PHASE_CHOOSE_CELL, watch.lap() );
+	event.record.region = grid.region( event.record.cell );
+	new_obs.push_back( find_new_points( ground_truth,
+					    ground_truth_index,
+					    ground_truth_observed,
+					    event.record.region ) );
+	num_observed_points += new_obs.back().size();
+	event.timings.add( PHASE_ORACLE, watch.lap() );
       }
 
-      // print out hte chosne region and cell
-      out_verbose_trace << "+CHOSEN-CELL+ " << next_cell << std::endl;
-      out_verbose_trace << "+CHOSEN-REGION+ " << region << std::endl;
-
-      // print out the new observations (if any)
-      out_verbose_trace << "+NEW-OBSERVATIONS+ ";
+      // decide whether the model update of this step is deferred:
+      // only steps without any new points are, and only while the
+      // deferred updates are within their count and time budgets
+      bool positive_step = false;
       for( size_t i = 0; i < new_obs.size(); ++i ) {
-	out_verbose_trace << new_obs[i] << " ";
+	positive_step = positive_step || !new_obs[ i ].empty();
+      }
+      if( num_deferred_updates == 0 ) {
+	deferred_watch.lap();
+      }
+      const char* flush_reason = NULL;
+      if( positive_step ) {
+	flush_reason = "positive";
+      } else if( options.max_deferred_negative_updates > 0 &&
+		 num_deferred_updates + events.size() >= options.max_deferred_negative_updates ) {
+	flush_reason = "count";
+      } else if( options.max_deferred_seconds > 0 &&
+		 deferred_watch.elapsed() >= options.max_deferred_seconds ) {
+	flush_reason = "time";
+      }
+      bool defer = options.defer_negative_updates && !positive_step && !flush_reason;
+      if( !options.defer_negative_updates || num_deferred_updates == 0 ) {
+	flush_reason = NULL;
       }
-      out_verbose_trace << std::endl;
-
-      // update chosen cells and regions
-      chosen_cells.push_back( next_cell );
-      chosen_regions.push_back( region );
-    
-      // Ok, add new observation or a negative region if no new obs
-      if( new_obs.empty() ) {
-	planner->add_negative_observation( next_cell );
-	chosen_region_negative.push_back( true );
 
-	// trace this
-	out_verbose_trace << "+ADD-NEGATIVE-OBSERVATION+ " << next_cell << std::endl;
+      // the mcmc budget of this step's model update, if scheduled
+      mcmc_budget_step_t budget_step;
+      bool scheduled = options.mcmc_budget_scheduler && !defer;
+      if( scheduled ) {
+	budget_step.iteration = iteration + events.size() - 1;
+	budget_step.base_budget = (unsigned long)base_params.update_model_mcmc_iterations;
+	budget_step.num_new_points = num_observed_points - num_observed_before_step;
+	params.update_model_mcmc_iterations
+	  = options.mcmc_budget_scheduler->budget( budget_step );
+      }
 
-      } else {
-      
-	// now add negative regions for the places in the cell without points
-	std::vector<nd_aabox_t> empty_regs = compute_empty_regions( new_obs, region );
-	if( add_empty_regions ) {
-	  for( size_t i = 0; i < empty_regs.size(); ++i ) {
-	    planner->add_empty_region( empty_regs[i] );
-	  }
+      // now add the observations to the planner. With more than one cell
+      // they are a batch, only the last triggers a model update (unless
+      // the update is deferred, then none do)
+      bool batch = ( events.size() > 1 );
+      if( batch || defer ) {
+	planner->set_grid_planner_parameters( batch_params );
+      } else if( scheduled ) {
+	planner->set_grid_planner_parameters( params );
+      }
+      size_t total_points = num_observed_before_step;
+      for( size_t i = 0; i < events.size(); ++i ) {
+	trace_event_t& event = events[ i ];
+	bool last = ( i + 1 == events.size() );
+	event.record.iteration = iteration;
+	event.add_empty_regions = add_empty_regions;
+
+	// Ok, add new observation or a negative region if no new obs
+	apply_observation( planner,
+			   add_empty_regions,
+			   new_obs[ i ],
+			   ( batch && last && !defer ) ? &params : NULL,
+			   event );
+	total_points += new_obs[ i ].size();
+	event.deferred_update = defer;
+	if( last && flush_reason ) {
+	  event.num_flushed_updates = num_deferred_updates;
+	  event.flush_reason = flush_reason;
 	}
-
-	// and add teh actual observations 
-	// (make sure this is AFTER the empty regions)
-	planner->add_observations( new_obs );
-	chosen_region_negative.push_back( false );      
-	
-	// trace this
-	if( add_empty_regions ) {
-	  out_verbose_trace << "+ADD-EMPTY-REGIONS+ ";
-	  for( size_t i = 0; i < empty_regs.size(); ++i ) {
-	    out_verbose_trace << empty_regs[i] << " ";
-	  }
-	  out_verbose_trace << std::endl;
+	if( last && scheduled ) {
+	  event.has_mcmc_budget = true;
+	  event.mcmc_budget = (unsigned long)params.update_model_mcmc_iterations;
+	  options.mcmc_budget_scheduler->update_done( budget_step,
+						      event.mcmc_budget,
+						      event.timings.seconds[ PHASE_MODEL_UPDATE ] );
 	}
-	out_verbose_trace << "+ADD-OBSERVATIONs+ ";
-	for( size_t i = 0; i < new_obs.size(); ++i ) {
-	  out_verbose_trace << new_obs[i] << " ";
+
+	// update position
+	event.position = event.record.region.start + 
+	  ( event.record.region.end - event.record.region.start ) * 0.5;
+	planner->set_current_position( event.position );
+
+	// add the cell as visited to the planner
+	if( last ) {
+	  planner->add_visited_cell( event.record.cell );
 	}
-	out_verbose_trace << std::endl;
 
+	// the planner trace, then hand the trace to the writer
+	// (the push itself can only be counted in the totals)
+	capture_planner_trace( planner, options, event );
+	event.record.total_points = total_points;
+	event.record.new_points.swap( new_obs[ i ] );
+	chosen_cells.push_back( event.record.cell );
+	run_timings.add( event.timings );
+	stopwatch_t watch;
+	trace_writer.push( event );
+	run_timings.add( PHASE_TRACE_PUSH, watch.lap() );
+      
+	// icrease iteration count
+	++iteration;
+	++num_visited_cells;
       }
 
-      // update position
-      planner->set_current_position( region.start + (region.end - region.start) * 0.5 );
+      // keep count of the deferred updates, which the update of this
+      // step (if there was one) has now included
+      if( defer ) {
+	num_deferred_updates += events.size();
+      } else {
+	num_deferred_updates = 0;
+      }
+      if( defer || scheduled ) {
+	planner->set_grid_planner_parameters( base_params );
+      }
+    }
 
-      // trace thjis
-      out_verbose_trace << "+SET-CURRENT-POSITION+ " << ( region.start + (region.end - region.start) * 0.5 ) << std::endl;
+    // make sure all of the traces are written
+    trace_writer.close();
 
+    // the aggregate timings for the whole run
+    run_timings.add( trace_writer.timings() );
+    out_meta << "stop-reason: " << stop_reason << std::endl;
+    if( num_deferred_updates > 0 ) {
+      out_meta << "pending-deferred-updates: " << num_deferred_updates << std::endl;
+    }
+    out_meta << "iterations: " << iteration << std::endl;
+    out_meta << "simulation-seconds: " << run_watch.elapsed() << std::endl;
+    run_timings.write_totals( out_meta );
+    out_meta.flush();
+  
+    // return the chosen cells
+    return chosen_cells;
+  
+  }
 
-      // add the cell as visited to the planner
-      planner->add_visited_cell( next_cell );
 
-      // trace this
-      out_verbose_trace << "+ADD-VISITED-CELL+ " << next_cell << std::endl;
+  //==========================================================================
 
-      // add to trace
-      if( true ) {
-	(out_trace) << iteration << " "
-		    << next_cell << " "
-		    << new_obs.size() << " "
-		    << planner->observations().size() << " "
-		    << region << " ";
-	for( size_t i = 0; i < new_obs.size(); ++i ) {
-	  (out_trace) << new_obs[ i ] << " ";
-	}
-	(out_trace) << std::endl;
-	(out_trace).flush();
+  // Description:
+  // Computes the empty regions of the records in [begin,end) which
+  // found points. Only touches its own records' entries so chunks can
+  // run in parallel.
+  static void
+  compute_record_empty_regions( const std::vector<trace_record_t>& records,
+				std::vector< std::vector<nd_aabox_t> >& empty_regions,
+				const size_t begin,
+				const size_t end )
+  {
+    for( size_t i = begin; i < end; ++i ) {
+      if( !records[ i ].new_points.empty() ) {
+	empty_regions[ i ] = compute_empty_regions( records[ i ].new_points,
+						    records[ i ].region );
       }
+    }
+  }
 
-    
-      // print the process model parameters to user
-      if( true && PRINT_PROGRESS ) {
+  //==========================================================================
 
-	// TODO: get an interface for printing out hte inner model state
-	//(*out_progress) << "[" << iteration << "]   " << std::endl;
-	//(*out_progress) << process->_state << std::endl;
-      
-	// print status to user
-	(out_progress) << "[" << iteration << "]   "
-		       <<  "cell: " << next_cell 
-		       << "  { #new= " << new_obs.size() << " total: " << planner->observations().size() << " }" 
-	  // << " entropy: " << entropy
-		       << std::endl;
-	(out_progress) << std::flush;
-      }
-
-      // trace the planner information (including the model parameters!)
-      out_verbose_trace << "+PLANNER+ ";
-      planner->print_shallow_trace( out_verbose_trace );
-      out_verbose_trace << std::endl;
-      out_verbose_trace << "+MODEL+ ";
-      planner->print_model_shallow_trace( out_verbose_trace );
-      out_verbose_trace << std::endl;
-      
-      
-      // icrease iteration count
-      ++iteration;
+  void
+  replay_trace_records
+  ( boost::shared_ptr<grid_planner_t>& planner,
+    bool add_empty_regions,
+    const std::vector<trace_record_t>& records )
+  {
+    if( records.empty() ) {
+      return;
+    }
+
+    // the empty regions do not depend on the planner, so work them
+    // all out up front in parallel
+    std::vector< std::vector<nd_aabox_t> > empty_regions( records.size() );
+    if( add_empty_regions ) {
+      parallel_for( records.size(),
+		    boost::bind( &compute_record_empty_regions,
+				 boost::cref( records ),
+				 boost::ref( empty_regions ),
+				 _1, _2 ) );
+    }
+
+    // batch update the planner without any mcmc
+    grid_planner_parameters_t old_params 
+      = planner->get_grid_planner_parameters();
+    grid_planner_parameters_t batch_params = old_params;
+    batch_params.update_model_mcmc_iterations = 0;
+    planner->set_grid_planner_parameters( batch_params );
+
+    for( size_t i = 0; i < records.size(); ++i ) {
+      const trace_record_t& record = records[ i ];
+      bool last = ( i + 1 == records.size() );
+
+      // the empty regions always go in before the observations
+      for( size_t j = 0; j < empty_regions[ i ].size(); ++j ) {
+	planner->add_empty_region( empty_regions[ i ][ j ] );
+      }
+
+      // restore the parameters for the last observation so that
+      // it triggers a *single* model update for the whole batch
+      if( last ) {
+	planner->set_grid_planner_parameters( old_params );
+      }
+      if( record.new_points.empty() ) {
+	planner->add_negative_observation( record.cell );
+      } else {
+	planner->add_observations( record.new_points );
+      }
+
+      planner->set_current_position( record.region.start + 
+				     ( record.region.end - record.region.start ) * 0.5 );
+      planner->add_visited_cell( record.cell );
     }
-  
-    // return the chosen cells
-    return chosen_cells;
-  
   }
 
 
 
   //==========================================================================
 
-  struct world_func_pair_t
+  // Description:
+  // One generated instance of a world (per seed for seeded worlds):
+  // once it has been asked for, the (immutable) ground truth and
+  // window. The mutex is only held while generating it, so different
+  // worlds (and seeds) can be generated at the same time and each is
+  // generated only once while it is in use.
+  // A seeded world's instance is only weakly referenced, so it is
+  // freed when the last run using it lets go of it; other worlds are
+  // kept (in kept) for good.
+  struct world_instance_t
+  {
+    std::mutex generate_mutex;
+    boost::weak_ptr<const world_data_t> data;
+    boost::shared_ptr<const world_data_t> kept;
+  };
+
+  // Description:
+  // A registered world: its generator functions (either groundtruth
+  // or seeded_groundtruth is set) and its instances by seed (only
+  // seed 0 for worlds which are not seeded). The instances mutex is
+  // only held for the map lookup/insert.
+  struct world_entry_t
   {
     boost::function< std::vector<math_core::nd_point_t> () > groundtruth;
+    boost::function< std::vector<math_core::nd_point_t> ( rng_stream_t& ) > seeded_groundtruth;
     boost::function< math_core::nd_aabox_t () > window;
+    std::mutex instances_mutex;
+    std::map< unsigned long, boost::shared_ptr<world_instance_t> > instances;
   };
-  std::map< std::string, world_func_pair_t > _g_worlds;
+
+  typedef boost::function< boost::shared_ptr<mcmc_point_process_t> (const math_core::nd_aabox_t&, const std::vector<math_core::nd_point_t>& ) > model_factory_t;
+  typedef boost::function< boost::shared_ptr<grid_planner_t> (boost::shared_ptr<point_process_core::mcmc_point_process_t>&) > planner_factory_t;
+
+  // The registries. All access goes through _g_registry_mutex, which is
+  // only held for the map lookup/insert itself (never while generating
+  // a world or building a model or planner)
+  std::mutex _g_registry_mutex;
+  std::map< std::string, boost::shared_ptr<world_entry_t> > _g_worlds;
+  std::map< std::string, model_factory_t > _g_models;
+  std::map< std::string, planner_factory_t > _g_planners;
+
+  //==========================================================================
 
   void
   register_world
@@ -434,26 +817,45 @@ namespace point_process_experiment_core {
     const boost::function<std::vector<math_core::nd_point_t> ()>& groundtruth,
     const boost::function< math_core::nd_aabox_t () >& window )
   {
+    boost::shared_ptr<world_entry_t> g( new world_entry_t() );
+    g->groundtruth = groundtruth;
+    g->window = window;
+
+    std::lock_guard<std::mutex> lock( _g_registry_mutex );
     if( _g_worlds.find( id ) != _g_worlds.end() ) {
       BOOST_THROW_EXCEPTION( id_already_used_exception() );
     }
-
-    world_func_pair_t g;
-    g.groundtruth = groundtruth;
-    g.window = window;
     _g_worlds[ id ] = g;
   }
 
 
   //==========================================================================
 
-  std::map< std::string, boost::function<  boost::shared_ptr<mcmc_point_process_t> (const math_core::nd_aabox_t&, const std::vector<math_core::nd_point_t>& ) > > _g_models;
+  void
+  register_seeded_world
+  ( const std::string& id,
+    const boost::function<std::vector<math_core::nd_point_t> ( rng_stream_t& )>& groundtruth,
+    const boost::function< math_core::nd_aabox_t () >& window )
+  {
+    boost::shared_ptr<world_entry_t> g( new world_entry_t() );
+    g->seeded_groundtruth = groundtruth;
+    g->window = window;
+
+    std::lock_guard<std::mutex> lock( _g_registry_mutex );
+    if( _g_worlds.find( id ) != _g_worlds.end() ) {
+      BOOST_THROW_EXCEPTION( id_already_used_exception() );
+    }
+    _g_worlds[ id ] = g;
+  }
+
+  //==========================================================================
 
   void
   register_model
   ( const std::string& id,
     const boost::function< boost::shared_ptr<mcmc_point_process_t> (const math_core::nd_aabox_t&, const std::vector<math_core::nd_point_t>& ) >& model )
   {
+    std::lock_guard<std::mutex> lock( _g_registry_mutex );
     if( _g_models.find( id ) != _g_models.end() ) {
       BOOST_THROW_EXCEPTION( id_already_used_exception() );
     }
@@ -464,13 +866,12 @@ namespace point_process_experiment_core {
 
   //==========================================================================
 
-  std::map< std::string, boost::function< boost::shared_ptr<grid_planner_t> (boost::shared_ptr<point_process_core::mcmc_point_process_t>&) > > _g_planners;
-
   void
   register_planner
   ( const std::string& id,
     const boost::function< boost::shared_ptr<grid_planner_t> (boost::shared_ptr<point_process_core::mcmc_point_process_t>&) >& planner )
   {
+    std::lock_guard<std::mutex> lock( _g_registry_mutex );
     if( _g_planners.find( id ) != _g_planners.end() ) {
       BOOST_THROW_EXCEPTION( id_already_used_exception() );
     }
@@ -479,15 +880,94 @@ namespace point_process_experiment_core {
   }
 
 
+  //==========================================================================
+
+  // Description:
+  // Removes the instances of a world which have been freed (and which
+  // nobody is generating). Called with the entry's instances mutex held.
+  static void
+  prune_freed_instances( world_entry_t& entry )
+  {
+    std::map< unsigned long, boost::shared_ptr<world_instance_t> >::iterator it
+      = entry.instances.begin();
+    while( it != entry.instances.end() ) {
+      // only the map has it, so nobody is generating it (or about to)
+      bool freed = false;
+      if( it->second.use_count() == 1 ) {
+	std::lock_guard<std::mutex> lock( it->second->generate_mutex );
+	freed = it->second->data.expired();
+      }
+      if( freed ) {
+	entry.instances.erase( it++ );
+      } else {
+	++it;
+      }
+    }
+  }
+
+  //==========================================================================
+
+  boost::shared_ptr<const world_data_t>
+  world_data_for_world( const std::string& id,
+			const unsigned long seed )
+  {
+    // find the entry
+    boost::shared_ptr<world_entry_t> entry;
+    {
+      std::lock_guard<std::mutex> lock( _g_registry_mutex );
+      std::map< std::string, boost::shared_ptr<world_entry_t> >::const_iterator it
+	= _g_worlds.find( id );
+      if( it == _g_worlds.end() ) {
+	BOOST_THROW_EXCEPTION( unknown_world_exception() );
+      }
+      entry = it->second;
+    }
+
+    // find the instance for the seed (worlds which are not seeded
+    // have just the one)
+    bool seeded = !entry->seeded_groundtruth.empty();
+    unsigned long instance_seed = seeded ? seed : 0;
+    boost::shared_ptr<world_instance_t> instance;
+    {
+      std::lock_guard<std::mutex> lock( entry->instances_mutex );
+      if( seeded ) {
+	prune_freed_instances( *entry );
+      }
+      boost::shared_ptr<world_instance_t>& slot = entry->instances[ instance_seed ];
+      if( !slot ) {
+	slot.reset( new world_instance_t() );
+      }
+      instance = slot;
+    }
+
+    // generate the world unless it is still in use, everyone else
+    // asking at the same time waits for (and shares) the result
+    std::lock_guard<std::mutex> lock( instance->generate_mutex );
+    boost::shared_ptr<const world_data_t> data = instance->data.lock();
+    if( !data ) {
+      boost::shared_ptr<world_data_t> generated( new world_data_t() );
+      if( seeded ) {
+	rng_stream_t rng( instance_seed, WORLD_RNG_STREAM );
+	generated->groundtruth = entry->seeded_groundtruth( rng );
+      } else {
+	generated->groundtruth = entry->groundtruth();
+      }
+      generated->window = entry->window();
+      data = generated;
+      instance->data = data;
+      if( !seeded ) {
+	instance->kept = data;
+      }
+    }
+    return data;
+  }
+  
   //==========================================================================
   
   std::vector<math_core::nd_point_t>
   groundtruth_for_world( const std::string& id )
   {
-    if( _g_worlds.find( id ) == _g_worlds.end() ) {
-      BOOST_THROW_EXCEPTION( unknown_world_exception() );
-    }
-    return _g_worlds[ id ].groundtruth();
+    return world_data_for_world( id )->groundtruth;
   }
 
   //==========================================================================
@@ -495,10 +975,7 @@ namespace point_process_experiment_core {
   math_core::nd_aabox_t
   window_for_world( const std::string& id )
   {
-    if( _g_worlds.find( id ) == _g_worlds.end() ) {
-      BOOST_THROW_EXCEPTION( unknown_world_exception() );
-    }
-    return _g_worlds[ id ].window();
+    return world_data_for_world( id )->window;
   }
 
   //==========================================================================
@@ -508,10 +985,17 @@ namespace point_process_experiment_core {
 		   const math_core::nd_aabox_t& window,
 		   const std::vector<math_core::nd_point_t>& groundtruth )
   {
-    if( _g_models.find( id ) == _g_models.end() ) {
-      BOOST_THROW_EXCEPTION( unknown_model_exception() );
+    model_factory_t factory;
+    {
+      std::lock_guard<std::mutex> lock( _g_registry_mutex );
+      std::map< std::string, model_factory_t >::const_iterator it
+	= _g_models.find( id );
+      if( it == _g_models.end() ) {
+	BOOST_THROW_EXCEPTION( unknown_model_exception() );
+      }
+      factory = it->second;
     }
-    return _g_models[ id ]( window, groundtruth );
+    return factory( window, groundtruth );
   }
 
   //==========================================================================
@@ -520,10 +1004,17 @@ namespace point_process_experiment_core {
   get_planner_by_id( const std::string& id,
 		     boost::shared_ptr<point_process_core::mcmc_point_process_t>& model )
   {
-    if( _g_planners.find( id ) == _g_planners.end() ) {
-      BOOST_THROW_EXCEPTION( unknown_planner_exception() );
+    planner_factory_t factory;
+    {
+      std::lock_guard<std::mutex> lock( _g_registry_mutex );
+      std::map< std::string, planner_factory_t >::const_iterator it
+	= _g_planners.find( id );
+      if( it == _g_planners.end() ) {
+	BOOST_THROW_EXCEPTION( unknown_planner_exception() );
+      }
+      factory = it->second;
     }
-    return _g_planners[ id ]( model );
+    return factory( model );
   }
 
 
@@ -537,10 +1028,9 @@ namespace point_process_experiment_core {
   {
     // build everything up and get the resulting visited grid from the 
     // planner
-    std::vector<math_core::nd_point_t> gt = groundtruth_for_world( world_id );
-    math_core::nd_aabox_t window = window_for_world( world_id );
+    boost::shared_ptr<const world_data_t> world = world_data_for_world( world_id );
     boost::shared_ptr<point_process_core::mcmc_point_process_t> model
-      = get_model_by_id( model_id, window, gt );
+      = get_model_by_id( model_id, world->window, world->groundtruth );
     boost::shared_ptr<planner_core::grid_planner_t> planner
       = get_planner_by_id( planner_id, model );
 
@@ -548,7 +1038,7 @@ namespace point_process_experiment_core {
       = planner->visited_grid().copy_structure<bool>();
       
     // ok, now convert the groundtruth into the grid
-    for( auto p : gt ) {
+    for( auto p : world->groundtruth ) {
       grid.set( p, true );
     }
 
@@ -562,6 +1052,7 @@ namespace point_process_experiment_core {
   template< typename TK, typename TV >
   std::vector<TK>
   keys( const std::map<TK,TV>& m ) {
+    std::lock_guard<std::mutex> lock( _g_registry_mutex );
     std::vector<TK> k;
     for( auto item : m ) {
       k.push_back( item.first );
@@ -598,6 +1089,7 @@ namespace point_process_experiment_core {
   void
   clear_all_registered_experiments()
   {
+    std::lock_guard<std::mutex> lock( _g_registry_mutex );
     _g_worlds.clear();
     _g_models.clear();
     _g_planners.clear();
@@ -1,8 +1,13 @@
 
-#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_data_io_HPP__ )
-#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_data_io_HPP__
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_experiment_utils_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_experiment_utils_HPP__
 
 
+#include "phase_timing.hpp"
+#include "trace_io.hpp"
+#include "point_index.hpp"
+#include "mcmc_budget.hpp"
+#include "rng_stream.hpp"
 #include <planner-core/planner.hpp>
 #include <boost/optional.hpp>
 #include <iosfwd>
@@ -24,12 +29,16 @@ namespace point_process_experiment_core {
   //
   // This returns the actual initial window (since this will be aliased 
   // to the marked grid used by the planner! )
+  //
+  // If timings is given, the time taken by each setup phase is
+  // added to it.
   math_core::nd_aabox_t
   setup_planner_with_initial_observations
   ( boost::shared_ptr<planner_core::grid_planner_t>& planner,
     bool add_empty_regions,
     const math_core::nd_aabox_t& initial_window,
-    const std::vector<math_core::nd_point_t>& ground_truth );
+    const std::vector<math_core::nd_point_t>& ground_truth,
+    phase_timings_t* timings = NULL );
 
 
   // Description:
@@ -39,6 +48,12 @@ namespace point_process_experiment_core {
   // We are given the initial window to seed the planner with and the
   // entire ground truth data of points to find.
   //
+  // Why the run stopped ("stop-reason: goal-reached", or the budget
+  // which ran out, or "cancelled"; see simulation_options_t),
+  // per-iteration phase timings ("timing <iteration> <phase>=<seconds>")
+  // and the totals for the run ("timing-total <phase>: <seconds> <count>
+  // <mean>") are written to out_meta.
+  //
   // Returns the decision trace of observed grid cells
   std::vector<point_process_core::marked_grid_cell_t>
   simulate_run_until_all_points_found
@@ -53,6 +68,148 @@ namespace point_process_experiment_core {
     std::ostream& out_verbose_trace );
 
 
+  // Description:
+  // How much of the verbose trace to produce. Sections which are not
+  // wanted are never computed (not just discarded).
+  //   TRACE_OFF      no verbose trace at all
+  //   TRACE_SUMMARY  the chosen cell, observations and planner updates
+  //                  of every iteration, but no planner/model traces
+  //   TRACE_SAMPLED  the summary every iteration, plus the planner and
+  //                  model traces every trace_sample_period iterations
+  //   TRACE_FULL     everything, every iteration
+  // planner.trace and the progress output are always written.
+  enum trace_level_t
+  {
+    TRACE_OFF,
+    TRACE_SUMMARY,
+    TRACE_SAMPLED,
+    TRACE_FULL
+  };
+
+  // Description:
+  // Optional settings for simulate_run_until_all_points_found
+  struct simulation_options_t
+  {
+    // If not NULL, every trace line is also written to this stream
+    // in the compact binary trace format (see trace_io.hpp)
+    std::ostream* out_binary_trace;
+
+    // If true the traces (trace, verbose trace, progress) are
+    // formatted and written by a background thread, off the planning
+    // thread. The streams must not be shared with other threads.
+    bool asynchronous_trace;
+
+    // How much verbose trace to produce (see trace_level_t)
+    trace_level_t verbose_trace_level;
+    std::size_t trace_sample_period;
+
+    // The number of the first iteration, and whether the binary trace
+    // stream continues an existing binary trace. Both are for
+    // continuing a run which was replayed (see replay_trace_records)
+    std::size_t start_iteration;
+    bool append_binary_trace;
+
+    // The number of cells chosen per planning step. With more than one,
+    // the planner chooses the cells of a step without any model updates
+    // in between, their observations are added as a batch with no mcmc
+    // iterations, and a single model update runs at the end of the step
+    std::size_t cells_per_step;
+
+    // If true, steps which find no new points do not update the model:
+    // their negative observations are added with no mcmc iterations and
+    // the update is left to the next step which finds points, or to the
+    // step which reaches max_deferred_negative_updates deferred cells or
+    // max_deferred_seconds since the first deferred cell (0 is no limit).
+    // Every update which includes deferred ones is recorded in the
+    // traces (see trace_writer_t)
+    bool defer_negative_updates;
+    std::size_t max_deferred_negative_updates;
+    double max_deferred_seconds;
+
+    // If given, chooses the mcmc iterations of every model update of
+    // the run (instead of the planner's fixed
+    // update_model_mcmc_iterations). The budget of each update is
+    // recorded in the traces (see trace_writer_t)
+    boost::shared_ptr<mcmc_budget_scheduler_t> mcmc_budget_scheduler;
+
+    // Run budgets (0 is no limit): the run stops before the next cell
+    // once it has done max_iterations iterations (counting any which
+    // were replayed), max_visited_cells cells are visited (including
+    // the initial window), it has run for max_seconds, or its model
+    // updates have taken max_mcmc_seconds.
+    std::size_t max_iterations;
+    std::size_t max_visited_cells;
+    double max_seconds;
+    double max_mcmc_seconds;
+
+    // If given, called before every step; returning true stops the run
+    // there (cooperative cancellation, e.g. by a sweep scheduler)
+    boost::function<bool ()> should_stop;
+
+    simulation_options_t()
+      : out_binary_trace( NULL ),
+	asynchronous_trace( true ),
+	verbose_trace_level( TRACE_FULL ),
+	trace_sample_period( 1 ),
+	start_iteration( 0 ),
+	append_binary_trace( false ),
+	cells_per_step( 1 ),
+	defer_negative_updates( false ),
+	max_deferred_negative_updates( 0 ),
+	max_deferred_seconds( 0 ),
+	max_iterations( 0 ),
+	max_visited_cells( 0 ),
+	max_seconds( 0 ),
+	max_mcmc_seconds( 0 )
+    {}
+  };
+
+  // Description:
+  // As simulate_run_until_all_points_found above, with the given
+  // options
+  std::vector<point_process_core::marked_grid_cell_t>
+  simulate_run_until_all_points_found
+  ( boost::shared_ptr<planner_core::grid_planner_t>& planner,
+    bool add_empty_regions, 
+    const math_core::nd_aabox_t& initial_window,
+    const double& fraction_truth_to_find,
+    const std::vector<math_core::nd_point_t>& ground_truth,
+    std::ostream& out_meta,
+    std::ostream& out_trace,
+    std::ostream& out_progress,
+    std::ostream& out_verbose_trace,
+    const simulation_options_t& options );
+
+
+  // Description:
+  // Builds a bucket index over the points where the buckets are
+  // the size of the cells of the given grid, so that looking up the
+  // points in a grid cell region only touches that cell's points.
+  // The index refers to (does not copy) the points, which should all
+  // have the grid's dimension (the first one is used to find the
+  // cell size).
+  point_index_t
+  index_points_by_grid_cells
+  ( const point_process_core::marked_grid_t<bool>& grid,
+    const std::vector<math_core::nd_point_t>& points );
+
+
+  // Description:
+  // Re-applies the iterations of a previous run's trace (the chosen
+  // cells and the points found in them) to a planner which has been
+  // seeded just as that run's planner was, so that the run can be
+  // continued from where the trace ends.
+  //
+  // Like setup_planner_with_initial_observations this is a batch:
+  // every record but the last is applied with no mcmc iterations, and
+  // the last one triggers a single model update.
+  void
+  replay_trace_records
+  ( boost::shared_ptr<planner_core::grid_planner_t>& planner,
+    bool add_empty_regions,
+    const std::vector<trace_record_t>& records );
+
+
 
   // Description:
   // Exception indicating that an unknown world was asked for
@@ -76,6 +233,29 @@ namespace point_process_experiment_core {
 
 
 
+  // Description:
+  // The ground truth and window of a world
+  struct world_data_t
+  {
+    std::vector<math_core::nd_point_t> groundtruth;
+    math_core::nd_aabox_t window;
+  };
+
+  // Description:
+  // Returns the ground truth and window for a world (by id).
+  // The world is generated the first time it is asked for and the
+  // same (shared, immutable) data is returned from then on.
+  // A seeded world (see register_seeded_world) is generated once per
+  // seed, other worlds ignore the seed. A seed's world is only kept
+  // while some returned pointer to it is alive: once the last run
+  // using it is done it is freed, and generated again (identically)
+  // if asked for after that.
+  // Safe to call from several threads at once, and different seeds of
+  // a world are generated concurrently.
+  boost::shared_ptr<const world_data_t>
+  world_data_for_world( const std::string& id,
+			const unsigned long seed = 0 );
+
   // Description:
   // Returns the ground truth for a vicen world (by id)
   std::vector<math_core::nd_point_t>
@@ -118,6 +298,22 @@ namespace point_process_experiment_core {
     const boost::function<std::vector<math_core::nd_point_t> ()>& groundtruth,
     const boost::function< math_core::nd_aabox_t () >& window );
   
+  // Description:
+  // The stream of a seed which seeded world ground truth is drawn from
+  // (see register_seeded_world)
+  const uint64_t WORLD_RNG_STREAM = 0;
+
+  // Description:
+  // Registers a world with a unique id whose ground truth is drawn
+  // from a random stream, so it depends only on the seed it is asked
+  // for with (see world_data_for_world). The ground truth of seed s is
+  // generated from rng_stream_t( s, WORLD_RNG_STREAM ).
+  void
+  register_seeded_world
+  ( const std::string& id,
+    const boost::function<std::vector<math_core::nd_point_t> ( rng_stream_t& )>& groundtruth,
+    const boost::function< math_core::nd_aabox_t () >& window );
+  
   // Description:
   // Registers a model with id
   void
@@ -1,8 +1,11 @@
 
 #include "geometry.hpp"
-#include <math_core/geom.hpp>
+#include <math-core/geom.hpp>
 #include <stdexcept>
 #include <algorithm>
+#include <cassert>
+#include <limits>
+#include <cmath>
 
 
 
@@ -12,76 +15,263 @@ using namespace math_core;
 namespace point_process_experiment_core {
 
 
+  //=========================================================================
+
+  // Description:
+  // The ends of the epsilon slab around a coordinate x. For large
+  // coordinates (or tiny epsilon) x +- epsilon rounds back to x, so
+  // the slab is widened to at least the neighbouring doubles and
+  // x is always strictly inside it
+  static double
+  slab_start( const double x, const double epsilon )
+  {
+    return std::min( x - epsilon,
+		     std::nextafter( x, -std::numeric_limits<double>::infinity() ) );
+  }
+
+  static double
+  slab_end( const double x, const double epsilon )
+  {
+    return std::max( x + epsilon,
+		     std::nextafter( x, std::numeric_limits<double>::infinity() ) );
+  }
+
+  //=========================================================================
+
+  // Description:
+  // Returns the sorted cut positions along a dimension: the region
+  // bounds and the epsilon slab ends of each of the points, clamped
+  // to the region so no cut (and so no empty region) is outside it
+  static std::vector<double>
+  sorted_ticks( const std::vector<nd_point_t>& points,
+		const nd_aabox_t& region,
+		const int dim,
+		const double epsilon )
+  {
+    const double start = region.start.coordinate[dim];
+    const double end = region.end.coordinate[dim];
+    std::vector<double> ticks;
+    ticks.reserve( 2 * points.size() + 2 );
+    ticks.push_back( start );
+    for( size_t i = 0; i < points.size(); ++i ) {
+      ticks.push_back( std::min( std::max( slab_start( points[i].coordinate[dim], epsilon ), start ), end ) );
+      ticks.push_back( std::min( std::max( slab_end( points[i].coordinate[dim], epsilon ), start ), end ) );
+    }
+    ticks.push_back( end );
+    std::sort( ticks.begin(), ticks.end() );
+    return ticks;
+  }
+
+  //=========================================================================
+
+  // Description:
+  // Returns the [first,last] interval indices (interval i is
+  // [ticks[i],ticks[i+1]] ) which contain the given value.
+  // Returns false if no interval contains the value
+  static bool
+  intervals_containing( const std::vector<double>& ticks,
+			const double x,
+			size_t& first,
+			size_t& last )
+  {
+    if( x < ticks.front() || x > ticks.back() ) {
+      return false;
+    }
+    size_t num_intervals = ticks.size() - 1;
+    size_t lo = std::lower_bound( ticks.begin(), ticks.end(), x ) - ticks.begin();
+    size_t hi = std::upper_bound( ticks.begin(), ticks.end(), x ) - ticks.begin();
+    first = ( lo > 0 ) ? lo - 1 : 0;
+    last = ( hi > 0 ) ? hi - 1 : 0;
+    if( last >= num_intervals ) {
+      last = num_intervals - 1;
+    }
+    return first <= last;
+  }
+
+  //=========================================================================
+
+  // Description:
+  // Orders points by a single coordinate
+  struct coordinate_less_t
+  {
+    int dim;
+    coordinate_less_t( int d ) : dim( d ) {}
+    bool operator() ( const nd_point_t* a, const nd_point_t* b ) const
+    {
+      return a->coordinate[dim] < b->coordinate[dim];
+    }
+  };
+
+  //=========================================================================
+
+  // Description:
+  // Recursive k-d split of a box given the points which are (closed)
+  // inside of it. Empty boxes are emitted as empty regions. Otherwise
+  // the box is cut along the given axis at the median point into a
+  // lower part, an upper part (both split further along the same axis)
+  // and an epsilon slab around the median which is split along the
+  // next axis. Once every axis has been cut the remaining box is within
+  // epsilon of a point along every axis and is not empty.
+  static void
+  split_empty_regions( const nd_aabox_t& box,
+		       std::vector<const nd_point_t*>& points,
+		       const int axis,
+		       const double epsilon,
+		       std::vector<nd_aabox_t>& empty_regions )
+  {
+    if( points.empty() ) {
+      for( int d = 0; d < box.start.n; ++d ) {
+	if( !( box.start.coordinate[d] < box.end.coordinate[d] ) ) {
+	  return;
+	}
+      }
+      empty_regions.push_back( box );
+      return;
+    }
+    if( axis >= box.start.n ) {
+      return;
+    }
+
+    // find the median point along the axis and its epsilon slab
+    size_t mid = points.size() / 2;
+    std::nth_element( points.begin(),
+		      points.begin() + mid,
+		      points.end(),
+		      coordinate_less_t( axis ) );
+    double m = points[ mid ]->coordinate[ axis ];
+    double lo = std::max( slab_start( m, epsilon ), box.start.coordinate[ axis ] );
+    double hi = std::min( slab_end( m, epsilon ), box.end.coordinate[ axis ] );
+
+    // partition the points into the (closed) lower, slab and upper boxes.
+    // A point on a cut belongs to both sides
+    std::vector<const nd_point_t*> lower, slab, upper;
+    for( size_t i = 0; i < points.size(); ++i ) {
+      double x = points[i]->coordinate[ axis ];
+      if( x <= lo ) lower.push_back( points[i] );
+      if( x >= lo && x <= hi ) slab.push_back( points[i] );
+      if( x >= hi ) upper.push_back( points[i] );
+    }
+    points.clear();
+
+    nd_aabox_t lower_box = box;
+    lower_box.end.coordinate[ axis ] = lo;
+    nd_aabox_t slab_box = box;
+    slab_box.start.coordinate[ axis ] = lo;
+    slab_box.end.coordinate[ axis ] = hi;
+    nd_aabox_t upper_box = box;
+    upper_box.start.coordinate[ axis ] = hi;
+
+    // the slab is never narrower than m, so the median point is in
+    // neither side and each side has fewer points than the box.
+    // A side is only split further if it has some width (a slab on
+    // the box boundary leaves a zero width side which still holds the
+    // points on the boundary but can have no empty regions)
+    const double start = box.start.coordinate[ axis ];
+    const double end = box.end.coordinate[ axis ];
+    if( start < lo ) {
+      split_empty_regions( lower_box, lower, axis, epsilon, empty_regions );
+    }
+    if( hi < end ) {
+      split_empty_regions( upper_box, upper, axis, epsilon, empty_regions );
+    }
+    split_empty_regions( slab_box, slab, axis + 1, epsilon, empty_regions );
+  }
+
+  //=========================================================================
+
+  // Description:
+  // The 2D sweep over sorted point ticks (see compute_empty_regions)
+  static std::vector<nd_aabox_t>
+  compute_empty_regions_2d( const std::vector<nd_point_t>& points,
+			    const nd_aabox_t& region,
+			    const double epsilon )
+  {
+    // only 2D points can be inside the region
+    std::vector<nd_point_t> points_2d;
+    points_2d.reserve( points.size() );
+    for( size_t i = 0; i < points.size(); ++i ) {
+      if( points[i].n == 2 ) {
+	points_2d.push_back( points[i] );
+      }
+    }
+
+    // the sorted x and y cut lines
+    std::vector<double> x_ticks = sorted_ticks( points_2d, region, 0, epsilon );
+    std::vector<double> y_ticks = sorted_ticks( points_2d, region, 1, epsilon );
+    size_t num_x = x_ticks.size() - 1;
+    size_t num_y = y_ticks.size() - 1;
+
+    // mark the (x,y) interval cells which contain a point, per x column.
+    // Each point is in O(1) cells so this is O(N log N) rather than
+    // testing every cell against every point
+    std::vector< std::vector<size_t> > occupied( num_x );
+    for( size_t i = 0; i < points_2d.size(); ++i ) {
+      size_t x0, x1, y0, y1;
+      if( !intervals_containing( x_ticks, points_2d[i].coordinate[0], x0, x1 ) ||
+	  !intervals_containing( y_ticks, points_2d[i].coordinate[1], y0, y1 ) ) {
+	continue;
+      }
+      for( size_t xi = x0; xi <= x1; ++xi ) {
+	for( size_t yi = y0; yi <= y1; ++yi ) {
+	  occupied[ xi ].push_back( yi );
+	}
+      }
+    }
+
+    // sweep the columns, emitting maximal runs of empty cells in each
+    // column as a single box
+    std::vector<nd_aabox_t> empty_regions;
+    for( size_t xi = 0; xi < num_x; ++xi ) {
+      if( !( x_ticks[xi] < x_ticks[xi+1] ) ) {
+	continue;
+      }
+      std::vector<size_t>& column = occupied[ xi ];
+      std::sort( column.begin(), column.end() );
+      column.erase( std::unique( column.begin(), column.end() ), column.end() );
+      column.push_back( num_y );
+
+      size_t run_start = 0;
+      for( size_t k = 0; k < column.size(); ++k ) {
+	size_t run_end = column[k];
+	if( run_start < run_end &&
+	    y_ticks[ run_start ] < y_ticks[ run_end ] ) {
+	  empty_regions.push_back( aabox( point( x_ticks[xi], y_ticks[run_start] ),
+					  point( x_ticks[xi+1], y_ticks[run_end] ) ) );
+	}
+	run_start = run_end + 1;
+      }
+    }
+  
+    return empty_regions;
+  }
 
   //=========================================================================
 
   std::vector<nd_aabox_t>
   compute_empty_regions( const std::vector<nd_point_t>& points,
 			 const nd_aabox_t& region,
-			 const double epsilon = 1e-7)
+			 const double epsilon )
   {
-    assert( region.start.n == 2 );
     assert( region.start.n > 0 );
-    if( region.start.n != 2 ) {
-      throw std::domain_error( "Canno compute empty regions, only implemented 2D case!" );
+    if( region.start.n < 1 || region.end.n != region.start.n ) {
+      throw std::domain_error( "Cannot compute empty regions of an undefined region!" );
     }
-    
-    // ok, first we need to sort the points by their x coordinate
-    // and another sorted by their y coordinates
-    int dim = region.start.n;
-    std::vector<nd_point_t> points_x( points );
-    std::sort( points_x.begin(),
-	       points_x.end(),
-	       &point_compare_x );
-    std::vector<nd_point_t> points_y( points );
-    std::sort( points_y.begin(),
-	       points_y.end(),
-	       &point_compare_y );
-  
-    // Now, create the x and y lines
-    std::vector< nd_point_t > x_line_ticks;
-    std::vector< nd_point_t > y_line_ticks;
-    x_line_ticks.push_back( region.start );
-    y_line_ticks.push_back( region.start );
-    for( size_t i = 0; i < points_x.size(); ++i ) {
-      nd_vector_t x_margin = ( epsilon * vector( axis_direction( dim, 0 ) ) );
-      x_line_ticks.push_back( points_x[i] + (-1.0 * x_margin) );
-      x_line_ticks.push_back( points_x[i] + x_margin );
-      nd_vector_t y_margin = ( epsilon * vector( axis_direction( dim, 1 ) ) );
-      y_line_ticks.push_back( points_y[i] + (-1.0 * y_margin) );
-      y_line_ticks.push_back( points_y[i] + y_margin );
+
+    if( region.start.n == 2 ) {
+      return compute_empty_regions_2d( points, region, epsilon );
     }
-    x_line_ticks.push_back( region.end );
-    y_line_ticks.push_back( region.end );
-  
-    // create all sub regions given the lines and return those which do not
-    // have a point in them
-    std::vector<nd_aabox_t> empty_regions;
-    for( size_t xi = 0; xi < x_line_ticks.size() - 1; ++xi ) {
-      nd_point_t xstart = x_line_ticks[xi];
-      nd_point_t xend = x_line_ticks[xi+1];
-      for( size_t yi = 0; yi < y_line_ticks.size() - 1; ++yi ) {
-	nd_point_t ystart = y_line_ticks[yi];
-	nd_point_t yend = y_line_ticks[yi+1];
-
-	nd_point_t start = point( xstart.coordinate[0],
-				  ystart.coordinate[1] );
-	nd_point_t end = point( xend.coordinate[0],
-				yend.coordinate[1] );
-	nd_aabox_t box = aabox( start, end );
-	bool empty = true;
-	for( size_t k = 0; k < points.size(); ++k ) {
-	  if( is_inside( points[k], box ) ) {
-	    empty = false;
-	    break;
-	  }
-	}
-	if( empty ) {
-	  empty_regions.push_back( box );
-	}
+
+    // only points inside the region matter for the k-d split
+    std::vector<const nd_point_t*> inside;
+    inside.reserve( points.size() );
+    for( size_t i = 0; i < points.size(); ++i ) {
+      if( is_inside( points[i], region ) ) {
+	inside.push_back( &points[i] );
       }
     }
-  
+
+    std::vector<nd_aabox_t> empty_regions;
+    split_empty_regions( region, inside, 0, epsilon, empty_regions );
     return empty_regions;
   }
 
@@ -1,6 +1,6 @@
 
-#if !defined(  __POINT_PROCESS_EXPERIMENT_CORE_SIMULATED_DATA_HPP__ )
-#define __POINT_PROCESS_EXPERIMENT_CORE_SIMULATED_DATA_HPP__
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_geometry_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_geometry_HPP__
 
 #include <vector>
 #include <math-core/types.hpp>
@@ -12,10 +12,19 @@ namespace point_process_experiment_core {
 
   
   // Description:
-  // Given a set of points in 2D and a large region,
+  // Given a set of points and a large region (of any dimension),
   // Returns the set of regions which do not have any of the points.
   // These regions are subregions of hte given region, and have a
-  // margin of the given epsilon around the points
+  // margin of the given epsilon around the points.
+  //
+  // In 2D the regions cover the same space as the grid of boxes made by
+  // cutting the region at (point +- epsilon) along each axis and keeping
+  // the boxes without points, but vertically adjacent empty boxes are
+  // merged so only O(#points) regions are returned.
+  //
+  // In any other dimension the region is split k-d tree style at the
+  // median point (with an epsilon slab around it), giving O(N log N)
+  // regions rather than the (2N+1)^d of a full grid.
   std::vector<math_core::nd_aabox_t>
   compute_empty_regions( const std::vector<math_core::nd_point_t>& points,
 			 const math_core::nd_aabox_t& region,
@@ -23,6 +32,7 @@ namespace point_process_experiment_core {
 
   //------------------------------------------------------------------------
 
+}
 
 #endif
 
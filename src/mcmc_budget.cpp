@@ -0,0 +1,231 @@
+
+#include "mcmc_budget.hpp"
+#include <sstream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+
+namespace point_process_experiment_core {
+
+
+  //=========================================================================
+
+  fixed_mcmc_budget_t::fixed_mcmc_budget_t( const unsigned long budget )
+    : _budget( budget )
+  {
+  }
+
+  //=========================================================================
+
+  unsigned long
+  fixed_mcmc_budget_t::budget( const mcmc_budget_step_t& step )
+  {
+    return _budget;
+  }
+
+  //=========================================================================
+
+  std::string
+  fixed_mcmc_budget_t::description() const
+  {
+    std::ostringstream oss;
+    oss << "fixed:" << _budget;
+    return oss.str();
+  }
+
+  //=========================================================================
+
+  decaying_mcmc_budget_t::decaying_mcmc_budget_t( const double factor,
+						  const unsigned long min_budget )
+    : _factor( factor ),
+      _min_budget( min_budget ),
+      _num_negative_steps( 0 )
+  {
+  }
+
+  //=========================================================================
+
+  unsigned long
+  decaying_mcmc_budget_t::budget( const mcmc_budget_step_t& step )
+  {
+    if( step.num_new_points > 0 ) {
+      _num_negative_steps = 0;
+    } else {
+      ++_num_negative_steps;
+    }
+    double b = step.base_budget * std::pow( _factor, (double)_num_negative_steps );
+    unsigned long budget = (unsigned long)std::floor( b + 0.5 );
+    if( budget < _min_budget ) {
+      budget = _min_budget;
+    }
+    return budget;
+  }
+
+  //=========================================================================
+
+  std::string
+  decaying_mcmc_budget_t::description() const
+  {
+    std::ostringstream oss;
+    oss << "decay:" << _factor << ":" << _min_budget;
+    return oss.str();
+  }
+
+  //=========================================================================
+
+  boost_after_positive_mcmc_budget_t::boost_after_positive_mcmc_budget_t
+  ( const double factor,
+    const std::size_t num_steps )
+    : _factor( factor ),
+      _num_steps( num_steps ),
+      _boosted_steps_left( 0 )
+  {
+  }
+
+  //=========================================================================
+
+  unsigned long
+  boost_after_positive_mcmc_budget_t::budget( const mcmc_budget_step_t& step )
+  {
+    bool boosted = false;
+    if( step.num_new_points > 0 ) {
+      _boosted_steps_left = _num_steps;
+      boosted = true;
+    } else if( _boosted_steps_left > 0 ) {
+      --_boosted_steps_left;
+      boosted = true;
+    }
+    if( !boosted ) {
+      return step.base_budget;
+    }
+    return (unsigned long)std::floor( step.base_budget * _factor + 0.5 );
+  }
+
+  //=========================================================================
+
+  std::string
+  boost_after_positive_mcmc_budget_t::description() const
+  {
+    std::ostringstream oss;
+    oss << "boost-after-positive:" << _factor << ":" << _num_steps;
+    return oss.str();
+  }
+
+  //=========================================================================
+
+  wall_clock_mcmc_budget_t::wall_clock_mcmc_budget_t( const double seconds_per_update,
+						      const unsigned long max_budget )
+    : _seconds_per_update( seconds_per_update ),
+      _max_budget( max_budget ),
+      _seconds_per_iteration( 0 )
+  {
+  }
+
+  //=========================================================================
+
+  unsigned long
+  wall_clock_mcmc_budget_t::budget( const mcmc_budget_step_t& step )
+  {
+    if( _seconds_per_iteration <= 0 ) {
+      return step.base_budget;
+    }
+    double b = std::floor( _seconds_per_update / _seconds_per_iteration );
+    if( _max_budget > 0 && b > _max_budget ) {
+      return _max_budget;
+    }
+    return b < 1 ? 1 : (unsigned long)b;
+  }
+
+  //=========================================================================
+
+  void
+  wall_clock_mcmc_budget_t::update_done( const mcmc_budget_step_t& step,
+					 const unsigned long budget,
+					 const double seconds )
+  {
+    if( budget == 0 ) {
+      return;
+    }
+
+    // a running (exponentially weighted) estimate, since the cost of an
+    // iteration grows with the number of observations
+    double s = seconds / budget;
+    if( _seconds_per_iteration <= 0 ) {
+      _seconds_per_iteration = s;
+    } else {
+      _seconds_per_iteration = 0.8 * _seconds_per_iteration + 0.2 * s;
+    }
+  }
+
+  //=========================================================================
+
+  std::string
+  wall_clock_mcmc_budget_t::description() const
+  {
+    std::ostringstream oss;
+    oss << "wall-clock:" << _seconds_per_update << ":" << _max_budget;
+    return oss.str();
+  }
+
+  //=========================================================================
+
+  // Description:
+  // Parses a number field of a scheduler description
+  static double
+  parse_field( const std::string& description,
+	       const std::string& field )
+  {
+    char* end = NULL;
+    double value = std::strtod( field.c_str(), &end );
+    if( field.empty() || *end != '\0' || value < 0 ) {
+      BOOST_THROW_EXCEPTION( invalid_mcmc_budget_scheduler_exception()
+			     << errinfo_mcmc_budget_scheduler( description ) );
+    }
+    return value;
+  }
+
+  //=========================================================================
+
+  boost::shared_ptr<mcmc_budget_scheduler_t>
+  mcmc_budget_scheduler_from_string( const std::string& description )
+  {
+    boost::shared_ptr<mcmc_budget_scheduler_t> scheduler;
+    if( description.empty() ) {
+      return scheduler;
+    }
+
+    // split on ':'
+    std::vector<std::string> fields;
+    std::istringstream iss( description );
+    std::string field;
+    while( std::getline( iss, field, ':' ) ) {
+      fields.push_back( field );
+    }
+
+    const std::string& name = fields[0];
+    if( name == "fixed" && fields.size() == 2 ) {
+      scheduler.reset( new fixed_mcmc_budget_t
+		       ( (unsigned long)parse_field( description, fields[1] ) ) );
+    } else if( name == "decay" && fields.size() == 3 ) {
+      scheduler.reset( new decaying_mcmc_budget_t
+		       ( parse_field( description, fields[1] ),
+			 (unsigned long)parse_field( description, fields[2] ) ) );
+    } else if( name == "boost-after-positive" && fields.size() == 3 ) {
+      scheduler.reset( new boost_after_positive_mcmc_budget_t
+		       ( parse_field( description, fields[1] ),
+			 (std::size_t)parse_field( description, fields[2] ) ) );
+    } else if( name == "wall-clock" && ( fields.size() == 2 || fields.size() == 3 ) ) {
+      scheduler.reset( new wall_clock_mcmc_budget_t
+		       ( parse_field( description, fields[1] ),
+			 fields.size() == 3 ? (unsigned long)parse_field( description, fields[2] ) : 0 ) );
+    } else {
+      BOOST_THROW_EXCEPTION( invalid_mcmc_budget_scheduler_exception()
+			     << errinfo_mcmc_budget_scheduler( description ) );
+    }
+    return scheduler;
+  }
+
+  //=========================================================================
+
+}
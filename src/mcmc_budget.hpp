@@ -0,0 +1,152 @@
+
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_mcmc_budget_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_mcmc_budget_HPP__
+
+#include <boost/shared_ptr.hpp>
+#include <boost/exception/all.hpp>
+#include <stdexcept>
+#include <string>
+#include <cstddef>
+
+namespace point_process_experiment_core {
+
+
+  // Description:
+  // What a scheduler knows about a planning step whose model update
+  // it is choosing the mcmc budget for
+  struct mcmc_budget_step_t
+  {
+    // the iteration of the observation which triggers the update
+    std::size_t iteration;
+
+    // the planner's own update_model_mcmc_iterations
+    unsigned long base_budget;
+
+    // the number of new points found in the step (0 for a negative step)
+    std::size_t num_new_points;
+  };
+
+
+  // Description:
+  // Chooses the number of mcmc iterations of each model update of a
+  // simulation run (instead of the fixed
+  // grid_planner_parameters_t::update_model_mcmc_iterations).
+  // A scheduler belongs to a single run.
+  class mcmc_budget_scheduler_t
+  {
+  public:
+    virtual ~mcmc_budget_scheduler_t() {}
+
+    // Description:
+    // The mcmc iterations for the model update of the step
+    virtual unsigned long budget( const mcmc_budget_step_t& step ) = 0;
+
+    // Description:
+    // Called after the update with the budget used and how long the
+    // update took
+    virtual void update_done( const mcmc_budget_step_t& step,
+			      const unsigned long budget,
+			      const double seconds )
+    {}
+
+    // Description:
+    // A description of the scheduler (as accepted by
+    // mcmc_budget_scheduler_from_string)
+    virtual std::string description() const = 0;
+  };
+
+
+  // Description:
+  // Always the given budget
+  class fixed_mcmc_budget_t : public mcmc_budget_scheduler_t
+  {
+  public:
+    explicit fixed_mcmc_budget_t( const unsigned long budget );
+    virtual unsigned long budget( const mcmc_budget_step_t& step );
+    virtual std::string description() const;
+  protected:
+    unsigned long _budget;
+  };
+
+
+  // Description:
+  // The base budget after a step which found points, decaying by the
+  // given factor with every negative step after it (the posterior
+  // changes less and less while nothing is found) down to min_budget
+  class decaying_mcmc_budget_t : public mcmc_budget_scheduler_t
+  {
+  public:
+    decaying_mcmc_budget_t( const double factor,
+			    const unsigned long min_budget );
+    virtual unsigned long budget( const mcmc_budget_step_t& step );
+    virtual std::string description() const;
+  protected:
+    double _factor;
+    unsigned long _min_budget;
+    std::size_t _num_negative_steps;
+  };
+
+
+  // Description:
+  // The base budget times the given factor for a step which found
+  // points and the following num_steps steps, otherwise the base budget
+  class boost_after_positive_mcmc_budget_t : public mcmc_budget_scheduler_t
+  {
+  public:
+    boost_after_positive_mcmc_budget_t( const double factor,
+					const std::size_t num_steps );
+    virtual unsigned long budget( const mcmc_budget_step_t& step );
+    virtual std::string description() const;
+  protected:
+    double _factor;
+    std::size_t _num_steps;
+    std::size_t _boosted_steps_left;
+  };
+
+
+  // Description:
+  // As many iterations as fit in the given wall clock seconds per
+  // update, from the measured time per iteration of earlier updates
+  // (the base budget until there is a measurement), capped at
+  // max_budget (0 for no cap)
+  class wall_clock_mcmc_budget_t : public mcmc_budget_scheduler_t
+  {
+  public:
+    wall_clock_mcmc_budget_t( const double seconds_per_update,
+			      const unsigned long max_budget = 0 );
+    virtual unsigned long budget( const mcmc_budget_step_t& step );
+    virtual void update_done( const mcmc_budget_step_t& step,
+			      const unsigned long budget,
+			      const double seconds );
+    virtual std::string description() const;
+  protected:
+    double _seconds_per_update;
+    unsigned long _max_budget;
+    double _seconds_per_iteration;
+  };
+
+
+  // Description:
+  // Exception thrown for a scheduler description which can not be
+  // parsed
+  struct invalid_mcmc_budget_scheduler_exception : public virtual std::exception,
+						   public virtual boost::exception
+  {
+  };
+
+  typedef boost::error_info<struct tag_mcmc_budget_scheduler, std::string> errinfo_mcmc_budget_scheduler;
+
+
+  // Description:
+  // Creates a (new) scheduler from a description:
+  //   "fixed:<budget>"
+  //   "decay:<factor>:<min budget>"
+  //   "boost-after-positive:<factor>:<steps>"
+  //   "wall-clock:<seconds per update>[:<max budget>]"
+  // An empty description gives no scheduler (NULL).
+  boost::shared_ptr<mcmc_budget_scheduler_t>
+  mcmc_budget_scheduler_from_string( const std::string& description );
+
+}
+
+#endif
@@ -0,0 +1,213 @@
+
+#include "parallel.hpp"
+#include <algorithm>
+#include <system_error>
+
+
+namespace point_process_experiment_core {
+
+
+  //=========================================================================
+
+  std::size_t
+  resolve_num_threads( const std::size_t num_threads )
+  {
+    if( num_threads > 0 ) {
+      return num_threads;
+    }
+    std::size_t hw = std::thread::hardware_concurrency();
+    if( hw < 1 ) {
+      hw = 1;
+    }
+    return hw;
+  }
+
+  //=========================================================================
+
+  static void
+  run_chunk( const boost::function<void (std::size_t, std::size_t)>& body,
+	     const std::size_t begin,
+	     const std::size_t end,
+	     std::exception_ptr& error )
+  {
+    try {
+      body( begin, end );
+    } catch( ... ) {
+      error = std::current_exception();
+    }
+  }
+
+  //=========================================================================
+
+  void
+  parallel_for( const std::size_t n,
+		const boost::function<void (std::size_t, std::size_t)>& body,
+		const std::size_t num_threads )
+  {
+    if( n == 0 ) {
+      return;
+    }
+    std::size_t threads = std::min( resolve_num_threads( num_threads ), n );
+    if( threads == 1 ) {
+      body( 0, n );
+      return;
+    }
+
+    // split into one contiguous chunk per thread, running the
+    // last chunk on the calling thread. If a thread cannot be started
+    // (e.g. EAGAIN when many runs are going at once) the calling
+    // thread runs all of the chunks which have no thread
+    std::size_t chunk = ( n + threads - 1 ) / threads;
+    std::vector<std::exception_ptr> errors( threads );
+    std::vector<std::thread> workers;
+    workers.reserve( threads - 1 );
+    for( std::size_t t = 0; t + 1 < threads; ++t ) {
+      std::size_t begin = t * chunk;
+      std::size_t end = std::min( n, begin + chunk );
+      if( begin >= end ) {
+	break;
+      }
+      try {
+	workers.push_back( std::thread( run_chunk,
+					std::cref( body ),
+					begin, end,
+					std::ref( errors[t] ) ) );
+      } catch( std::system_error& ) {
+	break;
+      }
+    }
+    std::size_t last_begin = std::min( n, workers.size() * chunk );
+    run_chunk( body, last_begin, n, errors[ threads - 1 ] );
+    for( std::size_t t = 0; t < workers.size(); ++t ) {
+      workers[t].join();
+    }
+
+    for( std::size_t t = 0; t < errors.size(); ++t ) {
+      if( errors[t] ) {
+	std::rethrow_exception( errors[t] );
+      }
+    }
+  }
+
+  //=========================================================================
+
+  worker_pool_t::worker_pool_t( const std::size_t num_threads )
+    : _num_running( 0 ),
+      _stopping( false )
+  {
+    // if a thread cannot be started the pool makes do with those
+    // which did (only failing if there are none, when there is also
+    // nothing to join)
+    std::size_t n = resolve_num_threads( num_threads );
+    _workers.reserve( n );
+    for( std::size_t i = 0; i < n; ++i ) {
+      try {
+	_workers.push_back( std::thread( &worker_pool_t::worker_loop, this ) );
+      } catch( std::system_error& ) {
+	if( _workers.empty() ) {
+	  throw;
+	}
+	break;
+      }
+    }
+  }
+
+  //=========================================================================
+
+  worker_pool_t::~worker_pool_t()
+  {
+    {
+      std::lock_guard<std::mutex> lock( _mutex );
+      _stopping = true;
+    }
+    _job_available.notify_all();
+    for( std::size_t i = 0; i < _workers.size(); ++i ) {
+      _workers[i].join();
+    }
+  }
+
+  //=========================================================================
+
+  void
+  worker_pool_t::submit( const boost::function<void ()>& job )
+  {
+    {
+      std::lock_guard<std::mutex> lock( _mutex );
+      _jobs.push_back( job );
+    }
+    _job_available.notify_one();
+  }
+
+  //=========================================================================
+
+  void
+  worker_pool_t::wait()
+  {
+    std::exception_ptr error;
+    {
+      std::unique_lock<std::mutex> lock( _mutex );
+      while( !_jobs.empty() || _num_running > 0 ) {
+	_all_done.wait( lock );
+      }
+      error = _error;
+      _error = std::exception_ptr();
+    }
+    if( error ) {
+      std::rethrow_exception( error );
+    }
+  }
+
+  //=========================================================================
+
+  std::size_t
+  worker_pool_t::size() const
+  {
+    return _workers.size();
+  }
+
+  //=========================================================================
+
+  void
+  worker_pool_t::worker_loop()
+  {
+    while( true ) {
+
+      // grab the next job (or quit once stopping with no jobs left)
+      boost::function<void ()> job;
+      {
+	std::unique_lock<std::mutex> lock( _mutex );
+	while( _jobs.empty() && !_stopping ) {
+	  _job_available.wait( lock );
+	}
+	if( _jobs.empty() ) {
+	  return;
+	}
+	job = _jobs.front();
+	_jobs.pop_front();
+	++_num_running;
+      }
+
+      // run it outside of the lock
+      std::exception_ptr error;
+      try {
+	job();
+      } catch( ... ) {
+	error = std::current_exception();
+      }
+
+      {
+	std::lock_guard<std::mutex> lock( _mutex );
+	if( error && !_error ) {
+	  _error = error;
+	}
+	--_num_running;
+	if( _jobs.empty() && _num_running == 0 ) {
+	  _all_done.notify_all();
+	}
+      }
+    }
+  }
+
+  //=========================================================================
+
+}
@@ -0,0 +1,92 @@
+
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_parallel_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_parallel_HPP__
+
+#include <boost/function.hpp>
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace point_process_experiment_core {
+
+
+  // Description:
+  // Returns the number of worker threads to use when asked for
+  // num_threads threads (0 means one per hardware core)
+  std::size_t
+  resolve_num_threads( const std::size_t num_threads );
+
+
+  // Description:
+  // Calls body( begin, end ) over contiguous chunks of the range
+  // [0,n) using up to num_threads threads (0 means one per core).
+  // The chunks are disjoint and cover the range, so bodies which only
+  // write to the elements of their own chunk need no locking.
+  // Returns once every chunk is done; if any body throws, the first
+  // exception is rethrown here. Chunks whose thread cannot be started
+  // run on the calling thread.
+  void
+  parallel_for( const std::size_t n,
+		const boost::function<void (std::size_t, std::size_t)>& body,
+		const std::size_t num_threads = 0 );
+
+
+  // Description:
+  // A fixed size pool of worker threads running submitted jobs in
+  // submission order. The threads are started on construction and
+  // joined on destruction (after finishing every submitted job).
+  //
+  // If a job throws, the first exception is kept and rethrown by
+  // wait(); the remaining jobs still run.
+  class worker_pool_t
+  {
+  public:
+
+    // Description:
+    // Starts num_threads workers (0 means one per core), or as many
+    // of them as can be started. Throws std::system_error only if no
+    // worker can be started
+    explicit worker_pool_t( const std::size_t num_threads = 0 );
+
+    // Description:
+    // Finishes all submitted jobs and joins the workers
+    ~worker_pool_t();
+
+    // Description:
+    // Queue a job to be run by one of the workers
+    void submit( const boost::function<void ()>& job );
+
+    // Description:
+    // Blocks until every submitted job has finished.
+    // Rethrows the first exception thrown by a job (if any)
+    void wait();
+
+    // Description:
+    // The number of worker threads
+    std::size_t size() const;
+
+  protected:
+
+    void worker_loop();
+
+    std::vector<std::thread> _workers;
+    std::deque< boost::function<void ()> > _jobs;
+    std::mutex _mutex;
+    std::condition_variable _job_available;
+    std::condition_variable _all_done;
+    std::size_t _num_running;
+    bool _stopping;
+    std::exception_ptr _error;
+
+  private:
+    worker_pool_t( const worker_pool_t& );
+    worker_pool_t& operator= ( const worker_pool_t& );
+  };
+
+}
+
+#endif
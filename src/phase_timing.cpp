@@ -0,0 +1,97 @@
+
+#include "phase_timing.hpp"
+#include <iostream>
+
+
+namespace point_process_experiment_core {
+
+
+  //=========================================================================
+
+  const char*
+  timing_phase_name( const timing_phase_t phase )
+  {
+    switch( phase ) {
+    case PHASE_CHOOSE_CELL: return "choose-cell";
+    case PHASE_ORACLE: return "oracle";
+    case PHASE_EMPTY_REGIONS: return "compute-empty-regions";
+    case PHASE_ADD_EMPTY_REGIONS: return "add-empty-regions";
+    case PHASE_MODEL_UPDATE: return "model-update";
+    case PHASE_TRACE_CAPTURE: return "trace-capture";
+    case PHASE_TRACE_PUSH: return "trace-push";
+    case PHASE_TRACE_WRITE: return "trace-write";
+    case PHASE_SETUP_INDEX: return "setup-index";
+    case PHASE_SETUP_CLASSIFY: return "setup-classify";
+    case PHASE_SETUP_BATCH: return "setup-batch";
+    case PHASE_SETUP_MODEL_UPDATE: return "setup-model-update";
+    default: return "unknown";
+    }
+  }
+
+  //=========================================================================
+
+  phase_timings_t::phase_timings_t()
+  {
+    for( int i = 0; i < NUM_TIMING_PHASES; ++i ) {
+      seconds[i] = 0;
+      count[i] = 0;
+    }
+  }
+
+  //=========================================================================
+
+  void
+  phase_timings_t::add( const timing_phase_t phase, const double s )
+  {
+    seconds[ phase ] += s;
+    count[ phase ] += 1;
+  }
+
+  //=========================================================================
+
+  void
+  phase_timings_t::add( const phase_timings_t& other )
+  {
+    for( int i = 0; i < NUM_TIMING_PHASES; ++i ) {
+      seconds[i] += other.seconds[i];
+      count[i] += other.count[i];
+    }
+  }
+
+  //=========================================================================
+
+  void
+  phase_timings_t::write_line( std::ostream& out ) const
+  {
+    bool first = true;
+    for( int i = 0; i < NUM_TIMING_PHASES; ++i ) {
+      if( count[i] == 0 ) {
+	continue;
+      }
+      if( !first ) {
+	out << " ";
+      }
+      out << timing_phase_name( (timing_phase_t)i ) << "=" << seconds[i];
+      first = false;
+    }
+  }
+
+  //=========================================================================
+
+  void
+  phase_timings_t::write_totals( std::ostream& out ) const
+  {
+    for( int i = 0; i < NUM_TIMING_PHASES; ++i ) {
+      if( count[i] == 0 ) {
+	continue;
+      }
+      out << "timing-total " << timing_phase_name( (timing_phase_t)i ) << ": "
+	  << seconds[i] << " " 
+	  << count[i] << " "
+	  << ( seconds[i] / count[i] ) << std::endl;
+    }
+  }
+
+  //=========================================================================
+
+}
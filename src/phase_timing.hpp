@@ -0,0 +1,100 @@
+
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_phase_timing_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_phase_timing_HPP__
+
+#include <chrono>
+#include <iosfwd>
+#include <cstddef>
+
+namespace point_process_experiment_core {
+
+
+  // Description:
+  // The phases of an experiment which are timed
+  // (see phase_timings_t)
+  enum timing_phase_t
+  {
+    // the simulation loop, per iteration
+    PHASE_CHOOSE_CELL,        // planner->choose_next_observation_cell
+    PHASE_ORACLE,             // ground truth lookup for the chosen cell
+    PHASE_EMPTY_REGIONS,      // compute_empty_regions
+    PHASE_ADD_EMPTY_REGIONS,  // planner->add_empty_region
+    PHASE_MODEL_UPDATE,       // add_observations / add_negative_observation
+    PHASE_TRACE_CAPTURE,      // capturing the planner/model traces
+    PHASE_TRACE_PUSH,         // handing the event to the trace writer
+    PHASE_TRACE_WRITE,        // formatting and writing the traces
+
+    // setup_planner_with_initial_observations
+    PHASE_SETUP_INDEX,        // bucketing the ground truth
+    PHASE_SETUP_CLASSIFY,     // negative/partial cells and empty regions
+    PHASE_SETUP_BATCH,        // the batch of planner updates (no mcmc)
+    PHASE_SETUP_MODEL_UPDATE, // the single model update at the end
+
+    NUM_TIMING_PHASES
+  };
+
+  // Description:
+  // The name of a phase as written to planner.meta
+  const char* timing_phase_name( const timing_phase_t phase );
+
+
+  // Description:
+  // Accumulated wall clock seconds (and number of timings) per phase
+  struct phase_timings_t
+  {
+    double seconds[ NUM_TIMING_PHASES ];
+    std::size_t count[ NUM_TIMING_PHASES ];
+
+    phase_timings_t();
+
+    // Description:
+    // Add a timing of a phase
+    void add( const timing_phase_t phase, const double s );
+
+    // Description:
+    // Add all of the timings of another set
+    void add( const phase_timings_t& other );
+
+    // Description:
+    // Writes "<phase>=<seconds>" for every timed phase on one line
+    // (no newline)
+    void write_line( std::ostream& out ) const;
+
+    // Description:
+    // Writes a "timing-total <phase>: <seconds> <count> <mean>" line
+    // for every timed phase
+    void write_totals( std::ostream& out ) const;
+  };
+
+
+  // Description:
+  // A wall clock stopwatch (steady clock)
+  class stopwatch_t
+  {
+  public:
+    stopwatch_t() : _start( std::chrono::steady_clock::now() ) {}
+
+    // Description:
+    // Seconds since construction (or the last lap)
+    double elapsed() const
+    {
+      return std::chrono::duration<double>( std::chrono::steady_clock::now() - _start ).count();
+    }
+
+    // Description:
+    // Seconds since construction (or the last lap), and restart
+    double lap()
+    {
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      double s = std::chrono::duration<double>( now - _start ).count();
+      _start = now;
+      return s;
+    }
+
+  protected:
+    std::chrono::steady_clock::time_point _start;
+  };
+
+}
+
+#endif
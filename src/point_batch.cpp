@@ -0,0 +1,155 @@
+
+#include "point_batch.hpp"
+#include <math-core/geom.hpp>
+#include <cmath>
+
+
+using namespace math_core;
+
+namespace point_process_experiment_core {
+
+
+  //=========================================================================
+
+  void
+  point_batch_t::resize( const std::size_t size )
+  {
+    for( std::size_t d = 0; d < coordinates.size(); ++d ) {
+      coordinates[d].resize( size );
+    }
+  }
+
+  //=========================================================================
+
+  std::vector<nd_point_t>
+  to_points( const point_batch_t& batch )
+  {
+    const std::size_t dimension = batch.dimension();
+    const std::size_t size = batch.size();
+    std::vector<nd_point_t> points( size );
+    for( std::size_t i = 0; i < size; ++i ) {
+      points[i].n = dimension;
+      points[i].coordinate.resize( dimension );
+      for( std::size_t d = 0; d < dimension; ++d ) {
+	points[i].coordinate[d] = batch.coordinates[d][i];
+      }
+    }
+    return points;
+  }
+
+  //=========================================================================
+
+  point_batch_t
+  to_point_batch( const std::vector<nd_point_t>& points )
+  {
+    if( points.empty() ) {
+      return point_batch_t();
+    }
+    const std::size_t dimension = points[0].n;
+    point_batch_t batch( dimension, points.size() );
+    for( std::size_t d = 0; d < dimension; ++d ) {
+      double* x = &batch.coordinates[d][0];
+      for( std::size_t i = 0; i < points.size(); ++i ) {
+	x[i] = points[i].coordinate[d];
+      }
+    }
+    return batch;
+  }
+
+  //=========================================================================
+
+  void fill_uniform( double* out,
+		     const std::size_t n,
+		     const double a,
+		     const double b,
+		     rng_stream_t& rng )
+  {
+    for( std::size_t i = 0; i < n; ++i ) {
+      out[i] = rng.uniform();
+    }
+    const double scale = b - a;
+    for( std::size_t i = 0; i < n; ++i ) {
+      out[i] = a + scale * out[i];
+    }
+  }
+
+  //=========================================================================
+
+  void fill_gaussian( double* out,
+		      const std::size_t n,
+		      const double mean,
+		      const double sigma,
+		      rng_stream_t& rng )
+  {
+    if( n == 0 ) {
+      return;
+    }
+
+    // the uniforms for the pairs of samples: u1 in (0,1] (so the log
+    // is finite) in the first half of the buffer and u2 in the second
+    const std::size_t pairs = ( n + 1 ) / 2;
+    std::vector<double> u( 2 * pairs );
+    for( std::size_t i = 0; i < pairs; ++i ) {
+      u[i] = 1.0 - rng.uniform();
+      u[ pairs + i ] = rng.uniform();
+    }
+
+    // Box-Muller over the whole buffer. The first half of the output
+    // gets the cosine and the second half the sine samples
+    const double* u1 = &u[0];
+    const double* u2 = &u[ pairs ];
+    const std::size_t half = n / 2;
+    for( std::size_t i = 0; i < half; ++i ) {
+      double r = sigma * std::sqrt( -2.0 * std::log( u1[i] ) );
+      double theta = 2.0 * M_PI * u2[i];
+      out[i] = mean + r * std::cos( theta );
+      out[ half + i ] = mean + r * std::sin( theta );
+    }
+
+    // an odd sample out
+    if( n % 2 ) {
+      double r = sigma * std::sqrt( -2.0 * std::log( u1[ half ] ) );
+      out[ n - 1 ] = mean + r * std::cos( 2.0 * M_PI * u2[ half ] );
+    }
+  }
+
+  //=========================================================================
+
+  std::size_t
+  clip_to_window( point_batch_t& batch,
+		  const nd_aabox_t& window )
+  {
+    const std::size_t size = batch.size();
+    if( size == 0 ) {
+      return 0;
+    }
+
+    // which points are inside, one coordinate buffer at a time
+    std::vector<unsigned char> inside( size, 1 );
+    for( std::size_t d = 0; d < batch.dimension(); ++d ) {
+      const double* x = &batch.coordinates[d][0];
+      const double low = window.start.coordinate[d];
+      const double high = window.end.coordinate[d];
+      unsigned char* keep = &inside[0];
+      for( std::size_t i = 0; i < size; ++i ) {
+	keep[i] &= (unsigned char)( ( x[i] >= low ) & ( x[i] <= high ) );
+      }
+    }
+
+    // compact every buffer
+    std::size_t kept = 0;
+    for( std::size_t d = 0; d < batch.dimension(); ++d ) {
+      double* x = &batch.coordinates[d][0];
+      kept = 0;
+      for( std::size_t i = 0; i < size; ++i ) {
+	x[ kept ] = x[i];
+	kept += inside[i];
+      }
+    }
+    batch.resize( kept );
+    return size - kept;
+  }
+
+  //=========================================================================
+
+}
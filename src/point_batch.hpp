@@ -0,0 +1,76 @@
+
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_point_batch_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_point_batch_HPP__
+
+#include "rng_stream.hpp"
+#include <math-core/types.hpp>
+#include <vector>
+#include <cstddef>
+
+namespace point_process_experiment_core {
+
+
+  // Description:
+  // A batch of points of the same dimension stored as structure of
+  // arrays: one contiguous buffer per coordinate, so kernels over a
+  // batch run as simple (vectorizable) loops over each buffer.
+  // Converted to/from nd_point_t only at the API boundary.
+  struct point_batch_t
+  {
+    // coordinates[ d ][ i ] is coordinate d of point i
+    std::vector< std::vector<double> > coordinates;
+
+    point_batch_t() {}
+    point_batch_t( const std::size_t dimension,
+		   const std::size_t size )
+      : coordinates( dimension, std::vector<double>( size, 0.0 ) )
+    {}
+
+    std::size_t dimension() const { return coordinates.size(); }
+    std::size_t size() const
+    { return coordinates.empty() ? 0 : coordinates[0].size(); }
+
+    // Description:
+    // Resizes every coordinate buffer
+    void resize( const std::size_t size );
+  };
+
+
+  // Description:
+  // The points of a batch (and a batch of points, which must all
+  // have the same dimension)
+  std::vector<math_core::nd_point_t>
+  to_points( const point_batch_t& batch );
+  point_batch_t
+  to_point_batch( const std::vector<math_core::nd_point_t>& points );
+
+
+  // Description:
+  // Fills out[0..n) with samples drawn from the random stream.
+  // The random bits are drawn first and then transformed in a
+  // separate loop (Box-Muller for gaussians) which the compiler can
+  // vectorize.
+  void fill_uniform( double* out,
+		     const std::size_t n,
+		     const double a,
+		     const double b,
+		     rng_stream_t& rng );
+  void fill_gaussian( double* out,
+		      const std::size_t n,
+		      const double mean,
+		      const double sigma,
+		      rng_stream_t& rng );
+
+
+  // Description:
+  // Removes the points of the batch which are outside of the window
+  // (keeping the order of the rest). The inside test is done per
+  // coordinate over whole buffers.
+  // Returns the number of points removed.
+  std::size_t
+  clip_to_window( point_batch_t& batch,
+		  const math_core::nd_aabox_t& window );
+
+}
+
+#endif
@@ -0,0 +1,389 @@
+
+#include "point_index.hpp"
+#include <math-core/geom.hpp>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <stdexcept>
+
+
+using namespace math_core;
+
+
+namespace point_process_experiment_core {
+
+
+  //=========================================================================
+
+  point_index_t::point_index_t()
+    : _points( NULL ),
+      _dim( 0 )
+  {
+    _offsets.push_back( 0 );
+  }
+
+  //=========================================================================
+
+  point_index_t::point_index_t( const std::vector<nd_point_t>& points,
+				const std::vector<double>& bucket_size )
+    : _points( &points ),
+      _dim( bucket_size.size() ),
+      _origin( bucket_size.size(), 0.0 ),
+      _bucket_size( bucket_size ),
+      _num_buckets( bucket_size.size(), 1 ),
+      _stride( bucket_size.size(), 1 )
+  {
+
+    // compute the bounds of the points (only those of the right dimension)
+    std::vector<double> max_coord( _dim, 0.0 );
+    bool first = true;
+    for( std::size_t i = 0; i < points.size(); ++i ) {
+      if( (std::size_t)points[i].n != _dim ) {
+	continue;
+      }
+      for( std::size_t d = 0; d < _dim; ++d ) {
+	double x = points[i].coordinate[d];
+	if( first || x < _origin[d] ) {
+	  _origin[d] = x;
+	}
+	if( first || x > max_coord[d] ) {
+	  max_coord[d] = x;
+	}
+      }
+      first = false;
+    }
+
+    // the number of buckets along each dimension, collapsing
+    // dimensions without a (valid) bucket size
+    for( std::size_t d = 0; d < _dim; ++d ) {
+      if( !( _bucket_size[d] > 0 ) ) {
+	_bucket_size[d] = 0;
+	_num_buckets[d] = 1;
+      } else {
+	_num_buckets[d] = (long)std::floor( ( max_coord[d] - _origin[d] ) / _bucket_size[d] ) + 1;
+      }
+      if( d > 0 ) {
+	_stride[d] = _stride[d-1] * (unsigned long long)_num_buckets[d-1];
+      }
+    }
+
+    // compute the key for every point and sort by key (stable so that
+    // indices within a bucket stay in increasing order)
+    std::vector< std::pair<unsigned long long, std::size_t> > keyed;
+    keyed.reserve( points.size() );
+    for( std::size_t i = 0; i < points.size(); ++i ) {
+      if( (std::size_t)points[i].n != _dim ) {
+	_unbucketed.push_back( i );
+	continue;
+      }
+      keyed.push_back( std::make_pair( key_for( points[i] ), i ) );
+    }
+    std::sort( keyed.begin(), keyed.end() );
+
+    // build the CSR bucket structure
+    _indices.reserve( keyed.size() );
+    for( std::size_t i = 0; i < keyed.size(); ++i ) {
+      if( _keys.empty() || _keys.back() != keyed[i].first ) {
+	_keys.push_back( keyed[i].first );
+	_offsets.push_back( i );
+      }
+      _indices.push_back( keyed[i].second );
+    }
+    _offsets.push_back( _indices.size() );
+  }
+
+  //=========================================================================
+
+  long
+  point_index_t::bucket_coordinate( const std::size_t d, const double x ) const
+  {
+    if( _bucket_size[d] == 0 ) {
+      return 0;
+    }
+    return (long)std::floor( ( x - _origin[d] ) / _bucket_size[d] );
+  }
+
+  //=========================================================================
+
+  unsigned long long
+  point_index_t::key_for( const nd_point_t& p ) const
+  {
+    unsigned long long key = 0;
+    for( std::size_t d = 0; d < _dim; ++d ) {
+      long c = bucket_coordinate( d, p.coordinate[d] );
+      if( c < 0 ) c = 0;
+      if( c >= _num_buckets[d] ) c = _num_buckets[d] - 1;
+      key += (unsigned long long)c * _stride[d];
+    }
+    return key;
+  }
+
+  //=========================================================================
+
+  std::vector<std::size_t>
+  point_index_t::indices_inside( const nd_aabox_t& region ) const
+  {
+    std::vector<std::size_t> found;
+    if( _points == NULL || _points->empty() ) {
+      return found;
+    }
+
+    // points we could not bucket are always checked
+    for( std::size_t i = 0; i < _unbucketed.size(); ++i ) {
+      if( is_inside( (*_points)[ _unbucketed[i] ], region ) ) {
+	found.push_back( _unbucketed[i] );
+      }
+    }
+
+    // compute the range of buckets (per dimension) touched by the region.
+    // Regions of a different dimension cannot contain bucketed points
+    if( (std::size_t)region.start.n != _dim ||
+	(std::size_t)region.end.n != _dim ||
+	_keys.empty() ) {
+      std::sort( found.begin(), found.end() );
+      return found;
+    }
+    std::vector<long> lo( _dim ), hi( _dim );
+    for( std::size_t d = 0; d < _dim; ++d ) {
+      lo[d] = std::max( 0L, bucket_coordinate( d, region.start.coordinate[d] ) );
+      hi[d] = std::min( _num_buckets[d] - 1, bucket_coordinate( d, region.end.coordinate[d] ) );
+      if( lo[d] > hi[d] ) {
+	std::sort( found.begin(), found.end() );
+	return found;
+      }
+    }
+
+    // walk every bucket in the range (odometer style) and check
+    // the points in it
+    std::vector<long> c( lo );
+    while( true ) {
+      unsigned long long key = 0;
+      for( std::size_t d = 0; d < _dim; ++d ) {
+	key += (unsigned long long)c[d] * _stride[d];
+      }
+      std::vector<unsigned long long>::const_iterator it
+	= std::lower_bound( _keys.begin(), _keys.end(), key );
+      if( it != _keys.end() && *it == key ) {
+	std::size_t b = it - _keys.begin();
+	for( std::size_t k = _offsets[b]; k < _offsets[b+1]; ++k ) {
+	  if( is_inside( (*_points)[ _indices[k] ], region ) ) {
+	    found.push_back( _indices[k] );
+	  }
+	}
+      }
+
+      // next bucket
+      std::size_t d = 0;
+      for( ; d < _dim; ++d ) {
+	if( c[d] < hi[d] ) {
+	  ++c[d];
+	  break;
+	}
+	c[d] = lo[d];
+      }
+      if( d == _dim ) {
+	break;
+      }
+    }
+
+    std::sort( found.begin(), found.end() );
+    return found;
+  }
+
+  //=========================================================================
+
+  std::vector<nd_point_t>
+  point_index_t::points_inside( const nd_aabox_t& region ) const
+  {
+    std::vector<std::size_t> idx = indices_inside( region );
+    std::vector<nd_point_t> points;
+    points.reserve( idx.size() );
+    for( std::size_t i = 0; i < idx.size(); ++i ) {
+      points.push_back( (*_points)[ idx[i] ] );
+    }
+    return points;
+  }
+
+  //=========================================================================
+
+  std::size_t
+  point_index_t::size() const
+  {
+    if( _points == NULL ) {
+      return 0;
+    }
+    return _points->size();
+  }
+
+  //=========================================================================
+
+  const nd_point_t&
+  point_index_t::at( const std::size_t i ) const
+  {
+    if( _points == NULL || i >= _points->size() ) {
+      throw std::out_of_range( "point_index_t::at index out of range" );
+    }
+    return (*_points)[ i ];
+  }
+
+  //=========================================================================
+
+  cell_point_buckets_t::cell_point_buckets_t( const nd_aabox_t& window,
+					      const std::vector<double>& bucket_size )
+    : _window( window ),
+      _dim( window.start.n ),
+      _bucket_size( bucket_size ),
+      _num_buckets( window.start.n, 1 ),
+      _stride( window.start.n, 1 ),
+      _size( 0 )
+  {
+    if( _bucket_size.size() != _dim ) {
+      throw std::domain_error( "cell_point_buckets_t needs a bucket size for each dimension of the window" );
+    }
+    for( std::size_t d = 0; d < _dim; ++d ) {
+      if( !( _bucket_size[d] > 0 ) ) {
+	_bucket_size[d] = 0;
+      } else {
+	_num_buckets[d] = std::max( 1L, (long)std::ceil( length( window, d ) / _bucket_size[d] ) );
+      }
+      if( d > 0 ) {
+	_stride[d] = _stride[d-1] * (unsigned long long)_num_buckets[d-1];
+      }
+    }
+  }
+
+  //=========================================================================
+
+  long
+  cell_point_buckets_t::bucket_coordinate( const std::size_t d, const double x ) const
+  {
+    if( _bucket_size[d] == 0 ) {
+      return 0;
+    }
+    long c = (long)std::floor( ( x - _window.start.coordinate[d] ) / _bucket_size[d] );
+    return std::min( std::max( c, 0L ), _num_buckets[d] - 1 );
+  }
+
+  //=========================================================================
+
+  void
+  cell_point_buckets_t::add( const point_batch_t& points )
+  {
+    if( points.size() == 0 ) {
+      return;
+    }
+    if( points.dimension() != _dim ) {
+      throw std::domain_error( "cell_point_buckets_t can only add points of the dimension of its window" );
+    }
+
+    // the bucket key of every point (one coordinate buffer at a time)
+    // and whether it is inside the window
+    const std::size_t n = points.size();
+    std::vector<unsigned long long> keys( n, 0 );
+    std::vector<unsigned char> inside( n, 1 );
+    for( std::size_t d = 0; d < _dim; ++d ) {
+      const double* x = &points.coordinates[d][0];
+      const double low = _window.start.coordinate[d];
+      const double high = _window.end.coordinate[d];
+      for( std::size_t i = 0; i < n; ++i ) {
+	inside[i] &= (unsigned char)( ( x[i] >= low ) & ( x[i] <= high ) );
+	keys[i] += (unsigned long long)bucket_coordinate( d, x[i] ) * _stride[d];
+      }
+    }
+
+    // append the coordinates of each point to its bucket
+    for( std::size_t i = 0; i < n; ++i ) {
+      if( !inside[i] ) {
+	continue;
+      }
+      std::vector<double>& bucket = _buckets[ keys[i] ];
+      for( std::size_t d = 0; d < _dim; ++d ) {
+	bucket.push_back( points.coordinates[d][i] );
+      }
+      ++_size;
+    }
+  }
+
+  //=========================================================================
+
+  std::vector<nd_point_t>
+  cell_point_buckets_t::points_inside( const nd_aabox_t& region ) const
+  {
+    std::vector<nd_point_t> found;
+    if( _buckets.empty() ||
+	(std::size_t)region.start.n != _dim ||
+	(std::size_t)region.end.n != _dim ) {
+      return found;
+    }
+
+    // the range of buckets touched by the region
+    std::vector<long> lo( _dim ), hi( _dim );
+    for( std::size_t d = 0; d < _dim; ++d ) {
+      if( region.end.coordinate[d] < _window.start.coordinate[d] ||
+	  region.start.coordinate[d] > _window.end.coordinate[d] ) {
+	return found;
+      }
+      lo[d] = bucket_coordinate( d, region.start.coordinate[d] );
+      hi[d] = bucket_coordinate( d, region.end.coordinate[d] );
+    }
+
+    // walk every bucket in the range (odometer style) and check
+    // the points in it
+    std::vector<long> c( lo );
+    nd_point_t p;
+    p.n = _dim;
+    p.coordinate.resize( _dim );
+    while( true ) {
+      unsigned long long key = 0;
+      for( std::size_t d = 0; d < _dim; ++d ) {
+	key += (unsigned long long)c[d] * _stride[d];
+      }
+      std::map< unsigned long long, std::vector<double> >::const_iterator it
+	= _buckets.find( key );
+      if( it != _buckets.end() ) {
+	const std::vector<double>& bucket = it->second;
+	for( std::size_t k = 0; k < bucket.size(); k += _dim ) {
+	  std::copy( bucket.begin() + k, bucket.begin() + k + _dim,
+		     p.coordinate.begin() );
+	  if( is_inside( p, region ) ) {
+	    found.push_back( p );
+	  }
+	}
+      }
+
+      // next bucket
+      std::size_t d = 0;
+      for( ; d < _dim; ++d ) {
+	if( c[d] < hi[d] ) {
+	  ++c[d];
+	  break;
+	}
+	c[d] = lo[d];
+      }
+      if( d == _dim ) {
+	break;
+      }
+    }
+
+    return found;
+  }
+
+  //=========================================================================
+
+  std::size_t
+  cell_point_buckets_t::size() const
+  {
+    return _size;
+  }
+
+  //=========================================================================
+
+  std::size_t
+  cell_point_buckets_t::num_buckets() const
+  {
+    return _buckets.size();
+  }
+
+  //=========================================================================
+
+}
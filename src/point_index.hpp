@@ -0,0 +1,140 @@
+
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_point_index_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_point_index_HPP__
+
+#include "point_batch.hpp"
+#include <math-core/types.hpp>
+#include <vector>
+#include <map>
+#include <cstddef>
+
+namespace point_process_experiment_core {
+
+
+  // Description:
+  // A uniform grid (bucket) index over a fixed set of points.
+  // The points are bucketed once at construction, after which the
+  // points inside a query region can be found by only looking at the
+  // buckets which overlap the region (rather than scanning every point).
+  //
+  // The index does NOT copy the points, so the given vector must
+  // outlive the index and must not be changed while it is in use.
+  class point_index_t
+  {
+  public:
+
+    // Description:
+    // An empty index
+    point_index_t();
+
+    // Description:
+    // Index the given points using buckets of the given size along
+    // each dimension. Buckets are anchored at the minimum coordinate
+    // of the points. Non-positive bucket sizes collapse that dimension
+    // into a single bucket.
+    point_index_t( const std::vector<math_core::nd_point_t>& points,
+		   const std::vector<double>& bucket_size );
+
+    // Description:
+    // Returns the indices (into the indexed points) of all points
+    // which are inside the given region, in increasing index order.
+    // This uses math_core::is_inside, so the answer is the same as a
+    // linear scan with is_inside over all the points.
+    std::vector<std::size_t>
+    indices_inside( const math_core::nd_aabox_t& region ) const;
+
+    // Description:
+    // Returns the points inside the given region (see indices_inside)
+    std::vector<math_core::nd_point_t>
+    points_inside( const math_core::nd_aabox_t& region ) const;
+
+    // Description:
+    // Returns the number of indexed points
+    std::size_t size() const;
+
+    // Description:
+    // Returns the indexed point with the given index
+    const math_core::nd_point_t& at( const std::size_t i ) const;
+
+  protected:
+
+    // Description:
+    // The linear bucket key for a point
+    unsigned long long key_for( const math_core::nd_point_t& p ) const;
+
+    // Description:
+    // The bucket coordinate along a dimension for a value
+    long bucket_coordinate( const std::size_t d, const double x ) const;
+
+    const std::vector<math_core::nd_point_t>* _points;
+    std::size_t _dim;
+    std::vector<double> _origin;
+    std::vector<double> _bucket_size;
+    std::vector<long> _num_buckets;
+    std::vector<unsigned long long> _stride;
+
+    // sorted (unique) keys of non-empty buckets, and CSR offsets
+    // into _indices for each of them
+    std::vector<unsigned long long> _keys;
+    std::vector<std::size_t> _offsets;
+    std::vector<std::size_t> _indices;
+
+    // points which could not be bucketed (wrong dimension), these
+    // are always checked on a query
+    std::vector<std::size_t> _unbucketed;
+  };
+
+
+  // Description:
+  // Points bucketed by a uniform grid of cells over a window, filled a
+  // batch at a time (e.g. straight from a streaming world generator)
+  // rather than built over an existing vector of points like
+  // point_index_t. Each bucket keeps the coordinates of its points
+  // packed together, so there is no nd_point_t per point until the
+  // points inside a region are asked for.
+  class cell_point_buckets_t
+  {
+  public:
+
+    // Description:
+    // Buckets of the given size along each dimension anchored at the
+    // start of the window. Points outside the window are dropped
+    cell_point_buckets_t( const math_core::nd_aabox_t& window,
+			  const std::vector<double>& bucket_size );
+
+    // Description:
+    // Adds the points of the batch (of the window's dimension)
+    void add( const point_batch_t& points );
+
+    // Description:
+    // Returns the points inside the given region (by
+    // math_core::is_inside), in bucket order
+    std::vector<math_core::nd_point_t>
+    points_inside( const math_core::nd_aabox_t& region ) const;
+
+    // Description:
+    // The number of points and of non-empty buckets
+    std::size_t size() const;
+    std::size_t num_buckets() const;
+
+  protected:
+
+    // Description:
+    // The (clamped) bucket coordinate along a dimension for a value
+    long bucket_coordinate( const std::size_t d, const double x ) const;
+
+    math_core::nd_aabox_t _window;
+    std::size_t _dim;
+    std::vector<double> _bucket_size;
+    std::vector<long> _num_buckets;
+    std::vector<unsigned long long> _stride;
+
+    // the packed coordinates of the points of each non-empty bucket
+    std::map< unsigned long long, std::vector<double> > _buckets;
+    std::size_t _size;
+  };
+
+
+}
+
+#endif
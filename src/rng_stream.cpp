@@ -0,0 +1,113 @@
+
+#include "rng_stream.hpp"
+#include <cmath>
+
+
+namespace point_process_experiment_core {
+
+
+  //=========================================================================
+
+  uint64_t splitmix64( uint64_t& state )
+  {
+    uint64_t z = ( state += 0x9e3779b97f4a7c15ULL );
+    z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+    return z ^ ( z >> 31 );
+  }
+
+  //=========================================================================
+
+  // Description:
+  // Mixes a seed and stream id into a single 64 bit key
+  static uint64_t
+  stream_key( const uint64_t seed, const uint64_t stream )
+  {
+    uint64_t state = seed;
+    state = splitmix64( state ) ^ stream;
+    return splitmix64( state );
+  }
+
+  //=========================================================================
+
+  rng_stream_t::rng_stream_t( const uint64_t seed,
+			      const uint64_t stream )
+    : _seed( seed ),
+      _stream( stream ),
+      _engine( stream_key( seed, stream ) ),
+      _has_spare_gaussian( false ),
+      _spare_gaussian( 0 )
+  {
+  }
+
+  //=========================================================================
+
+  rng_stream_t
+  rng_stream_t::split( const uint64_t child_stream ) const
+  {
+    return rng_stream_t( stream_key( _seed, _stream ), child_stream );
+  }
+
+  //=========================================================================
+
+  double
+  rng_stream_t::uniform()
+  {
+    return ( _engine() >> 11 ) * ( 1.0 / 9007199254740992.0 );
+  }
+
+  //=========================================================================
+
+  double
+  rng_stream_t::uniform( const double a, const double b )
+  {
+    return a + ( b - a ) * uniform();
+  }
+
+  //=========================================================================
+
+  double
+  rng_stream_t::gaussian( const double mean, const double sigma )
+  {
+    // Box-Muller gives two independent values, keep the second
+    if( _has_spare_gaussian ) {
+      _has_spare_gaussian = false;
+      return mean + sigma * _spare_gaussian;
+    }
+    double u1 = 1.0 - uniform(); // (0,1] so the log is finite
+    double u2 = uniform();
+    double r = std::sqrt( -2.0 * std::log( u1 ) );
+    double theta = 2.0 * M_PI * u2;
+    _spare_gaussian = r * std::sin( theta );
+    _has_spare_gaussian = true;
+    return mean + sigma * r * std::cos( theta );
+  }
+
+  //=========================================================================
+
+  unsigned int
+  rng_stream_t::poisson( const double lambda )
+  {
+    if( lambda <= 0 ) {
+      return 0;
+    }
+
+    // Knuth's multiplication method for small means, otherwise the
+    // standard library's (which is reproducible for a given build)
+    if( lambda < 30 ) {
+      double limit = std::exp( -lambda );
+      unsigned int k = 0;
+      double p = uniform();
+      while( p > limit ) {
+	++k;
+	p *= uniform();
+      }
+      return k;
+    }
+    std::poisson_distribution<unsigned int> distribution( lambda );
+    return distribution( *this );
+  }
+
+  //=========================================================================
+
+}
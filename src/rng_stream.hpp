@@ -0,0 +1,76 @@
+
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_rng_stream_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_rng_stream_HPP__
+
+#include <random>
+#include <stdint.h>
+
+namespace point_process_experiment_core {
+
+
+  // Description:
+  // A deterministic random number stream identified by a seed and a
+  // stream id. The same (seed, stream) always gives the same sequence
+  // and different streams of a seed are (statistically) independent,
+  // so every replicate/thread can own its stream and get bitwise
+  // reproducible results without sharing a generator.
+  //
+  // The (seed, stream) pair is mixed with SplitMix64 into the seed of
+  // a std::mt19937_64. A stream can be split into child streams (by
+  // id), which does not depend on how much of it has been drawn.
+  //
+  // This is a UniformRandomBitGenerator, so it can be given to the
+  // std algorithms and distributions (e.g. std::shuffle).
+  // A stream is not thread safe; use one per thread.
+  class rng_stream_t
+  {
+  public:
+
+    typedef uint64_t result_type;
+
+    explicit rng_stream_t( const uint64_t seed = 0,
+			   const uint64_t stream = 0 );
+
+    uint64_t seed() const { return _seed; }
+    uint64_t stream() const { return _stream; }
+
+    // Description:
+    // The child stream with the given id (a fresh stream, independent
+    // of this one and of its other children)
+    rng_stream_t split( const uint64_t child_stream ) const;
+
+    // Description:
+    // The next 64 random bits
+    result_type operator() () { return _engine(); }
+    static constexpr result_type min() { return std::mt19937_64::min(); }
+    static constexpr result_type max() { return std::mt19937_64::max(); }
+
+    // Description:
+    // Uniform in [0,1) (53 bits) and in [a,b)
+    double uniform();
+    double uniform( const double a, const double b );
+
+    // Description:
+    // Gaussian with given mean and standard deviation (Box-Muller)
+    double gaussian( const double mean, const double sigma );
+
+    // Description:
+    // Poisson with given mean
+    unsigned int poisson( const double lambda );
+
+  protected:
+    uint64_t _seed;
+    uint64_t _stream;
+    std::mt19937_64 _engine;
+    bool _has_spare_gaussian;
+    double _spare_gaussian;
+  };
+
+
+  // Description:
+  // The SplitMix64 step: advances state and returns its mixed output
+  uint64_t splitmix64( uint64_t& state );
+
+}
+
+#endif
@@ -1,6 +1,7 @@
 
 #include "simulated_data.hpp"
 #include <math-core/matrix.hpp>
+#include "truncated_normal.hpp"
 
 
 using namespace math_core;
@@ -74,6 +75,136 @@ namespace point_process_experiment_core {
     add_coordinate_independent_noise( points, noise, window );
   }
 
+  //=========================================================================
+
+  std::vector<math_core::nd_point_t>
+  simulate_line_point_clusters_gaussian_spread_poisson_size
+  ( const math_core::nd_aabox_t& window,
+    const size_t num_clusters,
+    const double cluster_spread_gaussian_sigma,
+    const double cluster_size_poisson_lambda,
+    rng_stream_t& rng )
+  {
+    point_batch_t centers
+      = lattice_cluster_centers( window,
+				 std::vector<size_t>( 1, num_clusters ) );
+    return to_points
+      ( simulate_point_clusters_gaussian_spread_poisson_size( window,
+							      centers,
+							      cluster_spread_gaussian_sigma,
+							      cluster_size_poisson_lambda,
+							      rng ) );
+  }
+
+  //=========================================================================
+
+  point_batch_t
+  lattice_cluster_centers
+  ( const math_core::nd_aabox_t& window,
+    const std::vector<size_t>& clusters_per_dimension )
+  {
+    const size_t dimension = clusters_per_dimension.size();
+    size_t num_clusters = dimension > 0 ? 1 : 0;
+    for( size_t d = 0; d < dimension; ++d ) {
+      num_clusters *= clusters_per_dimension[d];
+    }
+
+    // walk the lattice with dimension 0 varying fastest
+    point_batch_t centers( dimension, num_clusters );
+    size_t stride = 1;
+    for( size_t d = 0; d < dimension; ++d ) {
+      const size_t n = clusters_per_dimension[d];
+      double step = length( window, d ) / ( n + 1 );
+      double* x = num_clusters > 0 ? &centers.coordinates[d][0] : NULL;
+      for( size_t c = 0; c < num_clusters; ++c ) {
+	size_t k = ( c / stride ) % n;
+	x[c] = window.start.coordinate[d] + ( k + 0.5 ) * step;
+      }
+      stride *= n;
+    }
+    return centers;
+  }
+
+  //=========================================================================
+
+  point_batch_t
+  simulate_point_clusters_gaussian_spread_poisson_size
+  ( const math_core::nd_aabox_t& window,
+    const point_batch_t& cluster_centers,
+    const double cluster_spread_gaussian_sigma,
+    const double cluster_size_poisson_lambda,
+    rng_stream_t& rng )
+  {
+    // the number of points of each cluster (at least 1)
+    const size_t num_clusters = cluster_centers.size();
+    std::vector<size_t> offsets( num_clusters + 1, 0 );
+    for( size_t c = 0; c < num_clusters; ++c ) {
+      size_t num_points = rng.poisson( cluster_size_poisson_lambda );
+      if( num_points < 1 )
+	num_points = 1;
+      offsets[ c + 1 ] = offsets[ c ] + num_points;
+    }
+    const size_t total = offsets[ num_clusters ];
+
+    // the spread of every point, one coordinate at a time, shifted by
+    // the center of its cluster
+    point_batch_t points( cluster_centers.dimension(), total );
+    if( total == 0 ) {
+      return points;
+    }
+    for( size_t d = 0; d < points.dimension(); ++d ) {
+      double* x = &points.coordinates[d][0];
+      fill_gaussian( x, total, 0.0, cluster_spread_gaussian_sigma, rng );
+      const double* center = &cluster_centers.coordinates[d][0];
+      for( size_t c = 0; c < num_clusters; ++c ) {
+	const double shift = center[c];
+	for( size_t i = offsets[c]; i < offsets[ c + 1 ]; ++i ) {
+	  x[i] += shift;
+	}
+      }
+    }
+
+    clip_to_window( points, window );
+    return points;
+  }
+
+  //=========================================================================
+
+  void add_zero_mean_coordinate_independent_gaussian_noise
+  ( std::vector<math_core::nd_point_t>& points,
+    const double noise_sigma,
+    const math_core::nd_aabox_t& window,
+    rng_stream_t& rng )
+  {
+    point_batch_t batch = to_point_batch( points );
+    add_zero_mean_coordinate_independent_gaussian_noise( batch,
+							  noise_sigma,
+							  window,
+							  rng );
+    points = to_points( batch );
+  }
+
+  //=========================================================================
+
+  void add_zero_mean_coordinate_independent_gaussian_noise
+  ( point_batch_t& points,
+    const double noise_sigma,
+    const math_core::nd_aabox_t& window,
+    rng_stream_t& rng )
+  {
+    if( points.size() == 0 ) {
+      return;
+    }
+    for( size_t d = 0; d < points.dimension(); ++d ) {
+      add_truncated_gaussian_noise( &points.coordinates[d][0],
+				    points.size(),
+				    noise_sigma,
+				    window.start.coordinate[d],
+				    window.end.coordinate[d],
+				    rng );
+    }
+  }
+
   //=========================================================================
   //=========================================================================
   //=========================================================================
@@ -7,6 +7,8 @@
 #include <probability-core/types.hpp>
 #include <probability-core/distributions.hpp>
 #include <math-core/geom.hpp>
+#include "rng_stream.hpp"
+#include "point_batch.hpp"
 
 namespace point_process_experiment_core {
 
@@ -23,6 +25,47 @@ namespace point_process_experiment_core {
     const double cluster_spread_gaussian_sigma,
     const double cluster_size_poisson_lambda );
 
+  // Description:
+  // The same, drawing from the given random stream (rather than the
+  // shared global randomness) so the points are reproducible from the
+  // stream's seed and id. This is the batch generator below on a 1D
+  // lattice of clusters.
+  std::vector<math_core::nd_point_t>
+  simulate_line_point_clusters_gaussian_spread_poisson_size
+  ( const math_core::nd_aabox_t& window,
+    const size_t num_clusters,
+    const double cluster_spread_gaussian_sigma,
+    const double cluster_size_poisson_lambda,
+    rng_stream_t& rng );
+
+
+  // Description:
+  // The centers of a lattice of clusters over the window with
+  // clusters_per_dimension[d] clusters along dimension d (so 1D, 2D
+  // or N-D layouts), with dimension 0 varying fastest. Along each
+  // dimension the clusters are spread out as for the line clusters
+  // above, step = length / (n + 1) apart starting half a step in.
+  point_batch_t
+  lattice_cluster_centers
+  ( const math_core::nd_aabox_t& window,
+    const std::vector<size_t>& clusters_per_dimension );
+
+  // Description:
+  // Batch generator of gaussian clusters: around each of the given
+  // cluster centers a poisson (at least 1) number of points spread by
+  // an isotropic gaussian with the given sigma. Points outside the
+  // window are dropped.
+  // The counts are drawn first, then each coordinate buffer is filled
+  // with gaussian spread in bulk and shifted by its cluster's center,
+  // and the batch is clipped to the window in bulk (see point_batch.hpp).
+  point_batch_t
+  simulate_point_clusters_gaussian_spread_poisson_size
+  ( const math_core::nd_aabox_t& window,
+    const point_batch_t& cluster_centers,
+    const double cluster_spread_gaussian_sigma,
+    const double cluster_size_poisson_lambda,
+    rng_stream_t& rng );
+
 
   // Description:
   // Add zero mean gaussian noise to a set of points
@@ -32,6 +75,27 @@ namespace point_process_experiment_core {
   ( std::vector<math_core::nd_point_t>& points,
     const double noise_sigma,
     const math_core::nd_aabox_t& window );
+
+  // Description:
+  // The same, drawing from the given random stream. Rather than
+  // resampling whole points until they are inside the window, each
+  // coordinate is drawn from the gaussian truncated to the window
+  // (see truncated_normal.hpp). For a box window and independent
+  // coordinates this is the same distribution, but it takes one draw
+  // per coordinate however close to the edge a point is.
+  void add_zero_mean_coordinate_independent_gaussian_noise
+  ( std::vector<math_core::nd_point_t>& points,
+    const double noise_sigma,
+    const math_core::nd_aabox_t& window,
+    rng_stream_t& rng );
+
+  // Description:
+  // The same for a batch of points, a coordinate buffer at a time
+  void add_zero_mean_coordinate_independent_gaussian_noise
+  ( point_batch_t& points,
+    const double noise_sigma,
+    const math_core::nd_aabox_t& window,
+    rng_stream_t& rng );
   
 
   // Description:
@@ -70,6 +134,36 @@ namespace point_process_experiment_core {
     }
   }
 
+
+  // Description:
+  // Add coordinate independent noise drawn from the given random
+  // stream by noise_sampler, which is called as noise_sampler( rng )
+  // for one (double) noise value per coordinate.
+  // Ensures points stay within the given window (by resampling the
+  // whole point, prefer the truncated gaussian noise above when the
+  // noise is gaussian)
+  template<typename T_Sampler>
+  void add_coordinate_independent_noise
+  ( std::vector<math_core::nd_point_t>& points,
+    const T_Sampler& noise_sampler,
+    const math_core::nd_aabox_t& window,
+    rng_stream_t& rng )
+  {
+    for( size_t p_i = 0; p_i < points.size(); ++p_i ) {
+      math_core::nd_point_t p;
+
+      // resample the noise until the point is still within the window
+      do  {
+	p = points[p_i];
+	for( size_t c_i = 0; (long)c_i < p.n; ++c_i ) {
+	  p.coordinate[c_i] += noise_sampler( rng );
+	}
+      } while( math_core::is_inside( p, window ) == false );
+
+      points[ p_i ] = p;
+    }
+  }
+
 }
 
 #endif
@@ -0,0 +1,261 @@
+
+#include "trace_io.hpp"
+#include <math-core/geom.hpp>
+#include <math-core/io.hpp>
+#include <iostream>
+#include <cstring>
+
+
+using namespace math_core;
+using namespace point_process_core;
+
+
+namespace point_process_experiment_core {
+
+
+  //=========================================================================
+
+  static const char BINARY_TRACE_MAGIC[8] = { 'P','P','T','R','A','C','E','\0' };
+  static const uint32_t BINARY_TRACE_BYTE_ORDER = 0x01020304;
+
+  //=========================================================================
+
+  template< typename T >
+  static void
+  append( std::vector<char>& buffer, const T& value )
+  {
+    const char* p = (const char*)&value;
+    buffer.insert( buffer.end(), p, p + sizeof(T) );
+  }
+
+  //=========================================================================
+
+  template< typename T >
+  static bool
+  read_value( std::istream& in, T& value )
+  {
+    in.read( (char*)&value, sizeof(T) );
+    return (size_t)in.gcount() == sizeof(T);
+  }
+
+  //=========================================================================
+
+  void
+  write_text_trace_record( std::ostream& out,
+			   const trace_record_t& record )
+  {
+    out << record.iteration << " "
+	<< record.cell << " "
+	<< record.new_points.size() << " "
+	<< record.total_points << " "
+	<< record.region << " ";
+    for( size_t i = 0; i < record.new_points.size(); ++i ) {
+      out << record.new_points[ i ] << " ";
+    }
+    out << std::endl;
+  }
+
+  //=========================================================================
+
+  binary_trace_writer_t::binary_trace_writer_t( std::ostream& out,
+						const bool append )
+    : _out( out ),
+      _wrote_header( false ),
+      _append( append ),
+      _cell_dimension( 0 ),
+      _point_dimension( 0 )
+  {
+  }
+
+  //=========================================================================
+
+  void
+  binary_trace_writer_t::write( const trace_record_t& record )
+  {
+    _buffer.clear();
+
+    // the header takes its dimensions from the first record
+    if( !_wrote_header && _append ) {
+      _cell_dimension = record.cell.coordinate.size();
+      _point_dimension = record.region.start.n;
+      _wrote_header = true;
+    }
+    if( !_wrote_header ) {
+      _cell_dimension = record.cell.coordinate.size();
+      _point_dimension = record.region.start.n;
+      _buffer.insert( _buffer.end(), 
+		      BINARY_TRACE_MAGIC,
+		      BINARY_TRACE_MAGIC + sizeof(BINARY_TRACE_MAGIC) );
+      append( _buffer, BINARY_TRACE_BYTE_ORDER );
+      append( _buffer, BINARY_TRACE_VERSION );
+      append( _buffer, _cell_dimension );
+      append( _buffer, _point_dimension );
+      _wrote_header = true;
+    }
+
+    if( record.cell.coordinate.size() != _cell_dimension ||
+	(uint32_t)record.region.start.n != _point_dimension ||
+	(uint32_t)record.region.end.n != _point_dimension ) {
+      BOOST_THROW_EXCEPTION( std::domain_error( "binary trace records must all have the same cell and point dimension" ) );
+    }
+
+    // fixed width part
+    append( _buffer, record.iteration );
+    append( _buffer, record.total_points );
+    append( _buffer, (uint32_t)record.new_points.size() );
+    for( size_t i = 0; i < _cell_dimension; ++i ) {
+      append( _buffer, (int32_t)record.cell.coordinate[i] );
+    }
+    for( size_t i = 0; i < _point_dimension; ++i ) {
+      append( _buffer, record.region.start.coordinate[i] );
+    }
+    for( size_t i = 0; i < _point_dimension; ++i ) {
+      append( _buffer, record.region.end.coordinate[i] );
+    }
+
+    // the new points
+    for( size_t p = 0; p < record.new_points.size(); ++p ) {
+      if( (uint32_t)record.new_points[p].n != _point_dimension ) {
+	BOOST_THROW_EXCEPTION( std::domain_error( "binary trace points must have the region's dimension" ) );
+      }
+      for( size_t i = 0; i < _point_dimension; ++i ) {
+	append( _buffer, record.new_points[p].coordinate[i] );
+      }
+    }
+
+    _out.write( &_buffer[0], _buffer.size() );
+  }
+
+  //=========================================================================
+
+  void
+  binary_trace_writer_t::flush()
+  {
+    _out.flush();
+  }
+
+  //=========================================================================
+
+  binary_trace_reader_t::binary_trace_reader_t( std::istream& in )
+    : _in( in ),
+      _read_header( false ),
+      _cell_dimension( 0 ),
+      _point_dimension( 0 )
+  {
+  }
+
+  //=========================================================================
+
+  bool
+  binary_trace_reader_t::read_header()
+  {
+    char magic[ sizeof(BINARY_TRACE_MAGIC) ];
+    _in.read( magic, sizeof(magic) );
+    if( _in.gcount() == 0 ) {
+      return false; // empty trace
+    }
+    uint32_t byte_order = 0, version = 0;
+    if( (size_t)_in.gcount() != sizeof(magic) ||
+	std::memcmp( magic, BINARY_TRACE_MAGIC, sizeof(magic) ) != 0 ||
+	!read_value( _in, byte_order ) ||
+	byte_order != BINARY_TRACE_BYTE_ORDER ||
+	!read_value( _in, version ) ||
+	version != BINARY_TRACE_VERSION ||
+	!read_value( _in, _cell_dimension ) ||
+	!read_value( _in, _point_dimension ) ) {
+      BOOST_THROW_EXCEPTION( invalid_binary_trace_exception() );
+    }
+    _read_header = true;
+    return true;
+  }
+
+  //=========================================================================
+
+  bool
+  binary_trace_reader_t::read( trace_record_t& record )
+  {
+    if( !_read_header && !read_header() ) {
+      return false;
+    }
+
+    // a clean end of the trace is only allowed between records
+    if( !read_value( _in, record.iteration ) ) {
+      if( _in.gcount() == 0 ) {
+	return false;
+      }
+      BOOST_THROW_EXCEPTION( invalid_binary_trace_exception() );
+    }
+
+    uint32_t num_new_points = 0;
+    bool ok = read_value( _in, record.total_points ) && read_value( _in, num_new_points );
+
+    record.cell.n = _cell_dimension;
+    record.cell.coordinate.resize( _cell_dimension );
+    for( size_t i = 0; ok && i < _cell_dimension; ++i ) {
+      int32_t c = 0;
+      ok = read_value( _in, c );
+      record.cell.coordinate[i] = c;
+    }
+
+    std::vector<double> start( _point_dimension ), end( _point_dimension );
+    for( size_t i = 0; ok && i < _point_dimension; ++i ) {
+      ok = read_value( _in, start[i] );
+    }
+    for( size_t i = 0; ok && i < _point_dimension; ++i ) {
+      ok = read_value( _in, end[i] );
+    }
+    record.region = aabox( point( start ), point( end ) );
+
+    record.new_points.clear();
+    std::vector<double> coords( _point_dimension );
+    for( size_t p = 0; ok && p < num_new_points; ++p ) {
+      for( size_t i = 0; ok && i < _point_dimension; ++i ) {
+	ok = read_value( _in, coords[i] );
+      }
+      record.new_points.push_back( point( coords ) );
+    }
+
+    if( !ok ) {
+      BOOST_THROW_EXCEPTION( invalid_binary_trace_exception() );
+    }
+    return true;
+  }
+
+  //=========================================================================
+
+  std::vector<trace_record_t>
+  read_binary_trace_records( std::istream& in )
+  {
+    std::vector<trace_record_t> records;
+    binary_trace_reader_t reader( in );
+    trace_record_t record;
+    try {
+      while( reader.read( record ) ) {
+	records.push_back( record );
+      }
+    } catch( invalid_binary_trace_exception& ) {
+      if( !reader.has_header() ) {
+	throw;
+      }
+      // a truncated last record, keep what was complete
+    }
+    return records;
+  }
+
+  //=========================================================================
+
+  void
+  convert_binary_trace_to_text( std::istream& in,
+				std::ostream& out )
+  {
+    binary_trace_reader_t reader( in );
+    trace_record_t record;
+    while( reader.read( record ) ) {
+      write_text_trace_record( out, record );
+    }
+    out.flush();
+  }
+
+  //=========================================================================
+
+}
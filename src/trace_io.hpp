@@ -0,0 +1,135 @@
+
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_trace_io_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_trace_io_HPP__
+
+#include <math-core/types.hpp>
+#include <point-process-core/marked_grid.hpp>
+#include <boost/exception/all.hpp>
+#include <stdexcept>
+#include <iosfwd>
+#include <vector>
+#include <stdint.h>
+
+namespace point_process_experiment_core {
+
+
+  // Description:
+  // One iteration of a planner trace (one line of planner.trace)
+  struct trace_record_t
+  {
+    uint64_t iteration;
+    point_process_core::marked_grid_cell_t cell;
+    uint64_t total_points;
+    math_core::nd_aabox_t region;
+    std::vector<math_core::nd_point_t> new_points;
+  };
+
+
+  // Description:
+  // Exception thrown when a binary trace is not valid
+  // (wrong magic/version/byte order or truncated record)
+  struct invalid_binary_trace_exception : public virtual std::exception,
+					  public virtual boost::exception
+  {
+  };
+
+
+  // Description:
+  // The current binary trace format version.
+  //
+  // A binary trace is (native byte order) a header:
+  //   char[8]   magic "PPTRACE"
+  //   uint32_t  byte order mark (0x01020304)
+  //   uint32_t  version
+  //   uint32_t  cell dimension
+  //   uint32_t  point dimension
+  // followed by records, each a fixed width part:
+  //   uint64_t  iteration
+  //   uint64_t  total number of points found
+  //   uint32_t  number of new points
+  //   int32_t[cell dimension]    cell coordinates
+  //   double[point dimension]    region start
+  //   double[point dimension]    region end
+  // and a variable length tail:
+  //   double[number of new points * point dimension]  new points
+  // The header is written with the first record.
+  const uint32_t BINARY_TRACE_VERSION = 1;
+
+
+  // Description:
+  // Writes the record as a planner.trace text line
+  void
+  write_text_trace_record( std::ostream& out,
+			   const trace_record_t& record );
+
+
+  // Description:
+  // Writes trace records in the binary trace format to a stream.
+  // Records are buffered by the stream, call flush() to push them out.
+  // When appending, the stream already holds the header (and earlier
+  // records of the same dimensions) so no header is written.
+  class binary_trace_writer_t
+  {
+  public:
+    explicit binary_trace_writer_t( std::ostream& out,
+				    const bool append = false );
+
+    void write( const trace_record_t& record );
+
+    void flush();
+
+  protected:
+    std::ostream& _out;
+    bool _wrote_header;
+    bool _append;
+    uint32_t _cell_dimension;
+    uint32_t _point_dimension;
+    std::vector<char> _buffer;
+  };
+
+
+  // Description:
+  // Reads trace records from a binary trace stream
+  class binary_trace_reader_t
+  {
+  public:
+    explicit binary_trace_reader_t( std::istream& in );
+
+    // Description:
+    // Reads the next record, returning false at the end of the trace.
+    // Throws invalid_binary_trace_exception on a bad header or a
+    // truncated record
+    bool read( trace_record_t& record );
+
+    // Description:
+    // True once a valid header has been read
+    bool has_header() const
+    { return _read_header; }
+
+  protected:
+    bool read_header();
+
+    std::istream& _in;
+    bool _read_header;
+    uint32_t _cell_dimension;
+    uint32_t _point_dimension;
+  };
+
+
+  // Description:
+  // Reads every complete record of a binary trace. An incomplete last
+  // record (from a run which was killed while writing it) is dropped.
+  // Throws invalid_binary_trace_exception on a bad header.
+  std::vector<trace_record_t>
+  read_binary_trace_records( std::istream& in );
+
+
+  // Description:
+  // Converts a binary trace back into the planner.trace text format
+  void
+  convert_binary_trace_to_text( std::istream& in,
+				std::ostream& out );
+
+}
+
+#endif
@@ -0,0 +1,279 @@
+
+#include "trace_writer.hpp"
+#include <math-core/io.hpp>
+#include <iostream>
+#include <chrono>
+
+
+using namespace math_core;
+
+
+namespace point_process_experiment_core {
+
+
+  //=========================================================================
+
+  // how long a blocked writer/producer sleeps before re-checking the
+  // buffer (wakeups are normally signalled, this is only a backstop)
+  static const std::chrono::milliseconds TRACE_WRITER_POLL( 1 );
+
+  //=========================================================================
+
+  trace_writer_t::trace_writer_t( std::ostream& out_trace,
+				  std::ostream* out_progress,
+				  std::ostream& out_verbose_trace,
+				  std::ostream* out_binary_trace,
+				  std::ostream* out_timing,
+				  const bool asynchronous,
+				  const std::size_t capacity,
+				  const bool append_binary_trace )
+    : _out_trace( out_trace ),
+      _out_progress( out_progress ),
+      _out_verbose_trace( out_verbose_trace ),
+      _out_timing( out_timing ),
+      _asynchronous( asynchronous ),
+      _buffer( asynchronous ? capacity : 1 ),
+      _closing( false ),
+      _failed( false ),
+      _closed( false )
+  {
+    if( out_binary_trace ) {
+      _binary_trace.reset( new binary_trace_writer_t( *out_binary_trace,
+							      append_binary_trace ) );
+    }
+    if( _asynchronous ) {
+      _thread = std::thread( &trace_writer_t::writer_loop, this );
+    }
+  }
+
+  //=========================================================================
+
+  trace_writer_t::~trace_writer_t()
+  {
+    try {
+      close();
+    } catch( ... ) {
+      // never throw from the destructor (we may be unwinding already)
+    }
+  }
+
+  //=========================================================================
+
+  void
+  trace_writer_t::rethrow_error()
+  {
+    if( _failed.load() ) {
+      std::exception_ptr error;
+      {
+	std::lock_guard<std::mutex> lock( _mutex );
+	error = _error;
+	_error = std::exception_ptr();
+      }
+      if( error ) {
+	std::rethrow_exception( error );
+      }
+    }
+  }
+
+  //=========================================================================
+
+  void
+  trace_writer_t::push( trace_event_t& event )
+  {
+    if( !_asynchronous ) {
+      write( event );
+      return;
+    }
+
+    rethrow_error();
+    while( !_buffer.try_push( event ) ) {
+      std::unique_lock<std::mutex> lock( _mutex );
+      _space_available.wait_for( lock, TRACE_WRITER_POLL );
+    }
+    _data_available.notify_one();
+  }
+
+  //=========================================================================
+
+  void
+  trace_writer_t::close()
+  {
+    if( _closed ) {
+      return;
+    }
+    _closed = true;
+    if( _asynchronous ) {
+      _closing.store( true );
+      _data_available.notify_one();
+      _thread.join();
+    }
+    if( _binary_trace ) {
+      _binary_trace->flush();
+    }
+    _out_trace.flush();
+    _out_verbose_trace.flush();
+    if( _out_progress ) {
+      _out_progress->flush();
+    }
+    if( _out_timing ) {
+      _out_timing->flush();
+    }
+    rethrow_error();
+  }
+
+  //=========================================================================
+
+  void
+  trace_writer_t::consume( const trace_event_t& event )
+  {
+    // after a failure keep draining (so the producer never blocks)
+    // but stop writing
+    if( _failed.load() ) {
+      return;
+    }
+    try {
+      write( event );
+    } catch( ... ) {
+      std::lock_guard<std::mutex> lock( _mutex );
+      _error = std::current_exception();
+      _failed.store( true );
+    }
+  }
+
+  //=========================================================================
+
+  void
+  trace_writer_t::writer_loop()
+  {
+    trace_event_t event;
+    while( true ) {
+      if( _buffer.try_pop( event ) ) {
+	_space_available.notify_one();
+	consume( event );
+	continue;
+      }
+
+      // empty: once closing the producer has stopped, so anything it
+      // pushed before closing is visible now. Drain it and quit
+      if( _closing.load() ) {
+	while( _buffer.try_pop( event ) ) {
+	  consume( event );
+	}
+	return;
+      }
+
+      std::unique_lock<std::mutex> lock( _mutex );
+      _data_available.wait_for( lock, TRACE_WRITER_POLL );
+    }
+  }
+
+  //=========================================================================
+
+  void
+  trace_writer_t::write( const trace_event_t& event )
+  {
+    stopwatch_t watch;
+    write_traces( event );
+    double write_seconds = watch.elapsed();
+    _timings.add( PHASE_TRACE_WRITE, write_seconds );
+
+    if( _out_timing && event.num_flushed_updates > 0 ) {
+      (*_out_timing) << "deferred-updates-flushed " << event.record.iteration << " "
+		     << event.num_flushed_updates << " "
+		     << event.flush_reason << std::endl;
+    }
+    if( _out_timing && event.has_mcmc_budget ) {
+      (*_out_timing) << "mcmc-budget " << event.record.iteration << " "
+		     << event.mcmc_budget << std::endl;
+    }
+    if( _out_timing ) {
+      phase_timings_t timings = event.timings;
+      timings.add( PHASE_TRACE_WRITE, write_seconds );
+      (*_out_timing) << "timing " << event.record.iteration << " ";
+      timings.write_line( *_out_timing );
+      (*_out_timing) << std::endl;
+    }
+  }
+
+  //=========================================================================
+
+  void
+  trace_writer_t::write_traces( const trace_event_t& event )
+  {
+    const trace_record_t& record = event.record;
+
+    // the verbose trace
+    if( event.verbose ) {
+      write_verbose( event );
+    }
+
+    // the trace
+    write_text_trace_record( _out_trace, record );
+    _out_trace.flush();
+    if( _binary_trace ) {
+      _binary_trace->write( record );
+    }
+
+    // progress for the user
+    if( _out_progress ) {
+      (*_out_progress) << "[" << record.iteration << "]   "
+		       <<  "cell: " << record.cell 
+		       << "  { #new= " << record.new_points.size() << " total: " << record.total_points << " }" 
+		       << std::endl;
+      (*_out_progress) << std::flush;
+    }
+
+    // the planner and model traces
+    if( event.verbose && event.has_planner_trace ) {
+      _out_verbose_trace << "+PLANNER+ " << event.planner_trace << std::endl;
+      _out_verbose_trace << "+MODEL+ " << event.model_trace << std::endl;
+    }
+  }
+
+  //=========================================================================
+
+  void
+  trace_writer_t::write_verbose( const trace_event_t& event )
+  {
+    const trace_record_t& record = event.record;
+    _out_verbose_trace << "+ITERATION+ " << record.iteration << std::endl;
+    _out_verbose_trace << "+CHOSEN-CELL+ " << record.cell << std::endl;
+    _out_verbose_trace << "+CHOSEN-REGION+ " << record.region << std::endl;
+    _out_verbose_trace << "+NEW-OBSERVATIONS+ ";
+    for( size_t i = 0; i < record.new_points.size(); ++i ) {
+      _out_verbose_trace << record.new_points[i] << " ";
+    }
+    _out_verbose_trace << std::endl;
+    if( event.negative ) {
+      _out_verbose_trace << "+ADD-NEGATIVE-OBSERVATION+ " << record.cell << std::endl;
+    } else {
+      if( event.add_empty_regions ) {
+	_out_verbose_trace << "+ADD-EMPTY-REGIONS+ ";
+	for( size_t i = 0; i < event.empty_regions.size(); ++i ) {
+	  _out_verbose_trace << event.empty_regions[i] << " ";
+	}
+	_out_verbose_trace << std::endl;
+      }
+      _out_verbose_trace << "+ADD-OBSERVATIONs+ ";
+      for( size_t i = 0; i < record.new_points.size(); ++i ) {
+	_out_verbose_trace << record.new_points[i] << " ";
+      }
+      _out_verbose_trace << std::endl;
+    }
+    if( event.deferred_update ) {
+      _out_verbose_trace << "+DEFERRED-UPDATE+ " << record.cell << std::endl;
+    }
+    if( event.num_flushed_updates > 0 ) {
+      _out_verbose_trace << "+FLUSH-DEFERRED-UPDATES+ " << event.num_flushed_updates
+			 << " " << event.flush_reason << std::endl;
+    }
+    if( event.has_mcmc_budget ) {
+      _out_verbose_trace << "+MCMC-BUDGET+ " << event.mcmc_budget << std::endl;
+    }
+    _out_verbose_trace << "+SET-CURRENT-POSITION+ " << event.position << std::endl;
+    _out_verbose_trace << "+ADD-VISITED-CELL+ " << record.cell << std::endl;
+  }
+
+  //=========================================================================
+
+}
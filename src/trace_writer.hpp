@@ -0,0 +1,212 @@
+
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_trace_writer_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_trace_writer_HPP__
+
+#include "trace_io.hpp"
+#include "phase_timing.hpp"
+#include <math-core/types.hpp>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+#include <string>
+#include <iosfwd>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <cstddef>
+
+namespace point_process_experiment_core {
+
+
+  // Description:
+  // A bounded single-producer/single-consumer ring buffer.
+  // One thread may push and one (other) thread may pop, without locks.
+  // Elements are swapped in and out, so pushing leaves the given value
+  // holding whatever (default constructed) value was in the slot.
+  template< typename T >
+  class spsc_ring_buffer_t
+  {
+  public:
+
+    explicit spsc_ring_buffer_t( const std::size_t capacity )
+      : _slots( std::max( capacity, (std::size_t)1 ) + 1 ),
+	_head( 0 ),
+	_tail( 0 )
+    {}
+
+    // Description:
+    // Push a value, returns false (leaving value alone) if full
+    bool try_push( T& value )
+    {
+      std::size_t tail = _tail.load( std::memory_order_relaxed );
+      std::size_t next = ( tail + 1 ) % _slots.size();
+      if( next == _head.load( std::memory_order_acquire ) ) {
+	return false;
+      }
+      std::swap( _slots[ tail ], value );
+      _tail.store( next, std::memory_order_release );
+      return true;
+    }
+
+    // Description:
+    // Pop a value, returns false if empty
+    bool try_pop( T& value )
+    {
+      std::size_t head = _head.load( std::memory_order_relaxed );
+      if( head == _tail.load( std::memory_order_acquire ) ) {
+	return false;
+      }
+      std::swap( value, _slots[ head ] );
+      _slots[ head ] = T();
+      _head.store( ( head + 1 ) % _slots.size(), std::memory_order_release );
+      return true;
+    }
+
+    // Description:
+    // The number of elements the buffer can hold
+    std::size_t capacity() const
+    {
+      return _slots.size() - 1;
+    }
+
+  protected:
+    std::vector<T> _slots;
+    std::atomic<std::size_t> _head;
+    std::atomic<std::size_t> _tail;
+  };
+
+
+  // Description:
+  // Everything traced about a single iteration of the simulation loop
+  // (see simulate_run_until_all_points_found).
+  // Expensive parts (planner and model traces) are captured as text
+  // by the planning thread since they depend on the planner state,
+  // and only when has_planner_trace is set.
+  // Nothing goes to the verbose trace unless verbose is set.
+  // The timings are the planning thread's phase timings for the
+  // iteration (the writer adds its own trace-write time).
+  // A deferred_update event did not update the model; an event with
+  // num_flushed_updates > 0 updated it for that many deferred events
+  // too (flush_reason says why the update was not deferred).
+  // has_mcmc_budget is set on events whose update had a scheduled
+  // mcmc budget.
+  struct trace_event_t
+  {
+    trace_record_t record;
+    bool negative;
+    bool add_empty_regions;
+    std::vector<math_core::nd_aabox_t> empty_regions;
+    math_core::nd_point_t position;
+    bool verbose;
+    bool has_planner_trace;
+    std::string planner_trace;
+    std::string model_trace;
+    phase_timings_t timings;
+    bool deferred_update;
+    std::size_t num_flushed_updates;
+    std::string flush_reason;
+    bool has_mcmc_budget;
+    unsigned long mcmc_budget;
+
+    trace_event_t() 
+      : negative( false ), 
+	add_empty_regions( false ),
+	verbose( true ),
+	has_planner_trace( true ),
+	deferred_update( false ),
+	num_flushed_updates( 0 ),
+	has_mcmc_budget( false ),
+	mcmc_budget( 0 )
+    {}
+  };
+
+
+  // Description:
+  // Writes trace events to the planner.trace, progress and verbose
+  // trace streams (and an optional binary trace).
+  //
+  // When asynchronous, events are handed to a dedicated writer thread
+  // through a bounded ring buffer so formatting and I/O happen off the
+  // planning thread; push only blocks when the buffer is full.
+  // close() (or the destructor, e.g. while unwinding an exception)
+  // writes every event pushed so far before returning.
+  //
+  // If out_timing is given, a "timing <iteration> <phase>=<seconds> ..."
+  // line is written there for every event, including the time taken
+  // to write the event itself, and a "deferred-updates-flushed
+  // <iteration> <count> <reason>" line for every flush of deferred
+  // model updates and a "mcmc-budget <iteration> <budget>" line for
+  // every scheduled model update.
+  //
+  // If append_binary_trace is set the binary trace stream is continuing
+  // an existing binary trace (see binary_trace_writer_t).
+  //
+  // The streams must not be used by anyone else until close().
+  class trace_writer_t
+  {
+  public:
+
+    trace_writer_t( std::ostream& out_trace,
+		    std::ostream* out_progress,
+		    std::ostream& out_verbose_trace,
+		    std::ostream* out_binary_trace,
+		    std::ostream* out_timing,
+		    const bool asynchronous = true,
+		    const std::size_t capacity = 1024,
+		    const bool append_binary_trace = false );
+
+    ~trace_writer_t();
+
+    // Description:
+    // Write (or queue) an event. The event is taken over (swapped out).
+    // Rethrows any error raised by the writer thread
+    void push( trace_event_t& event );
+
+    // Description:
+    // Write all queued events, stop the writer thread and flush the
+    // streams. Rethrows any error raised by the writer thread.
+    // Safe to call more than once.
+    void close();
+
+    // Description:
+    // The total time spent writing events (valid after close())
+    const phase_timings_t& timings() const
+    { return _timings; }
+
+  protected:
+
+    void write( const trace_event_t& event );
+    void write_traces( const trace_event_t& event );
+    void write_verbose( const trace_event_t& event );
+    void consume( const trace_event_t& event );
+    void writer_loop();
+    void rethrow_error();
+
+    std::ostream& _out_trace;
+    std::ostream* _out_progress;
+    std::ostream& _out_verbose_trace;
+    boost::shared_ptr<binary_trace_writer_t> _binary_trace;
+    std::ostream* _out_timing;
+    phase_timings_t _timings;
+
+    bool _asynchronous;
+    spsc_ring_buffer_t<trace_event_t> _buffer;
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _data_available;
+    std::condition_variable _space_available;
+    std::atomic<bool> _closing;
+    std::atomic<bool> _failed;
+    std::exception_ptr _error;
+    bool _closed;
+
+  private:
+    trace_writer_t( const trace_writer_t& );
+    trace_writer_t& operator= ( const trace_writer_t& );
+  };
+
+}
+
+#endif
@@ -0,0 +1,139 @@
+
+#include "truncated_normal.hpp"
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+
+namespace point_process_experiment_core {
+
+
+  //=========================================================================
+
+  double normal_cdf( const double x )
+  {
+    return 0.5 * std::erfc( -x * M_SQRT1_2 );
+  }
+
+  //=========================================================================
+
+  double normal_quantile( const double p )
+  {
+    if( p <= 0 ) {
+      return -std::numeric_limits<double>::infinity();
+    }
+    if( p >= 1 ) {
+      return std::numeric_limits<double>::infinity();
+    }
+
+    // Acklam's coefficients
+    static const double a[] = { -3.969683028665376e+01, 2.209460984245205e+02,
+				-2.759285104469687e+02, 1.383577518672690e+02,
+				-3.066479806614716e+01, 2.506628277459239e+00 };
+    static const double b[] = { -5.447609879822406e+01, 1.615858368580409e+02,
+				-1.556989798598866e+02, 6.680131188771972e+01,
+				-1.328068155288572e+01 };
+    static const double c[] = { -7.784894002430293e-03, -3.223964580411365e-01,
+				-2.400758277161838e+00, -2.549732539343734e+00,
+				4.374664141464968e+00, 2.938163982698783e+00 };
+    static const double d[] = { 7.784695709041462e-03, 3.224671290700398e-01,
+				2.445134137142996e+00, 3.754408661907416e+00 };
+    const double p_low = 0.02425;
+
+    double x;
+    if( p < p_low ) {
+      double q = std::sqrt( -2 * std::log( p ) );
+      x = ( ( ( ( ( c[0] * q + c[1] ) * q + c[2] ) * q + c[3] ) * q + c[4] ) * q + c[5] ) /
+	( ( ( ( d[0] * q + d[1] ) * q + d[2] ) * q + d[3] ) * q + 1 );
+    } else if( p <= 1 - p_low ) {
+      double q = p - 0.5;
+      double r = q * q;
+      x = ( ( ( ( ( a[0] * r + a[1] ) * r + a[2] ) * r + a[3] ) * r + a[4] ) * r + a[5] ) * q /
+	( ( ( ( ( b[0] * r + b[1] ) * r + b[2] ) * r + b[3] ) * r + b[4] ) * r + 1 );
+    } else {
+      double q = std::sqrt( -2 * std::log1p( -p ) );
+      x = -( ( ( ( ( c[0] * q + c[1] ) * q + c[2] ) * q + c[3] ) * q + c[4] ) * q + c[5] ) /
+	( ( ( ( d[0] * q + d[1] ) * q + d[2] ) * q + d[3] ) * q + 1 );
+    }
+
+    // one Halley step against the exact cdf
+    double e = normal_cdf( x ) - p;
+    double u = e * std::sqrt( 2 * M_PI ) * std::exp( 0.5 * x * x );
+    x = x - u / ( 1 + 0.5 * x * u );
+    return x;
+  }
+
+  //=========================================================================
+
+  double truncated_normal_quantile( const double u,
+				    const double a,
+				    const double b )
+  {
+    // keep the interval in the lower tail, mirroring it if needed
+    const bool mirror = ( a > 0 );
+    const double low = mirror ? -b : a;
+    const double high = mirror ? -a : b;
+
+    double z;
+    double cdf_low = normal_cdf( low );
+    double cdf_high = normal_cdf( high );
+    double mass = cdf_high - cdf_low;
+    if( mass > 1e-300 ) {
+      z = normal_quantile( cdf_low + u * mass );
+    } else {
+      // so far out that the mass underflows: the density is
+      // ~ exp( -high * ( z - high ) ) below high (a truncated
+      // exponential)
+      double rate = -high;
+      double width = high - low;
+      z = high + std::log1p( -u * -std::expm1( -rate * width ) ) / rate;
+    }
+
+    // rounding can step just outside
+    if( !( z >= low ) ) {
+      z = low;
+    }
+    if( !( z <= high ) ) {
+      z = high;
+    }
+    return mirror ? -z : z;
+  }
+
+  //=========================================================================
+
+  void add_truncated_gaussian_noise( double* x,
+				     const std::size_t n,
+				     const double sigma,
+				     const double low,
+				     const double high,
+				     rng_stream_t& rng )
+  {
+    if( n == 0 ) {
+      return;
+    }
+
+    // no noise, but still keep inside
+    if( !( sigma > 0 ) ) {
+      for( std::size_t i = 0; i < n; ++i ) {
+	x[i] = std::min( std::max( x[i], low ), high );
+      }
+      return;
+    }
+
+    std::vector<double> u( n );
+    for( std::size_t i = 0; i < n; ++i ) {
+      u[i] = rng.uniform();
+    }
+    const double inverse_sigma = 1.0 / sigma;
+    for( std::size_t i = 0; i < n; ++i ) {
+      double z = truncated_normal_quantile( u[i],
+					    ( low - x[i] ) * inverse_sigma,
+					    ( high - x[i] ) * inverse_sigma );
+      x[i] = std::min( std::max( x[i] + sigma * z, low ), high );
+    }
+  }
+
+  //=========================================================================
+
+}
@@ -0,0 +1,49 @@
+
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_truncated_normal_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_truncated_normal_HPP__
+
+#include "rng_stream.hpp"
+#include <cstddef>
+
+namespace point_process_experiment_core {
+
+
+  // Description:
+  // The standard normal cdf (through erfc, so accurate far into the
+  // lower tail)
+  double normal_cdf( const double x );
+
+  // Description:
+  // The standard normal quantile (inverse cdf) of p in (0,1):
+  // Acklam's rational approximation refined with one Halley step
+  // against normal_cdf (full double precision).
+  // Returns -/+ infinity for p <= 0 and p >= 1.
+  double normal_quantile( const double p );
+
+  // Description:
+  // The standard normal truncated to [a,b] evaluated at quantile u in
+  // [0,1) by inverting its cdf in closed form. An interval in the
+  // upper tail is mirrored into the lower tail (where the cdf keeps
+  // its precision), and one so far out that its mass underflows uses
+  // the exponential tail approximation. The result is always in [a,b].
+  double truncated_normal_quantile( const double u,
+				    const double a,
+				    const double b );
+
+  // Description:
+  // Adds zero mean gaussian noise with given sigma to each of x[0..n)
+  // drawn from the gaussian truncated so that the result stays in
+  // [low,high]: one uniform per value, so the time is bounded
+  // (unlike resampling until the value is inside).
+  // The uniforms are drawn first and then the whole buffer is
+  // transformed in a separate loop.
+  void add_truncated_gaussian_noise( double* x,
+				     const std::size_t n,
+				     const double sigma,
+				     const double low,
+				     const double high,
+				     rng_stream_t& rng );
+
+}
+
+#endif
@@ -0,0 +1,508 @@
+
+#include "world_snapshot.hpp"
+#include "experiment_utils.hpp"
+#include "data_io.hpp"
+#include <math-core/geom.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/exception/errinfo_file_name.hpp>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstddef>
+#include <mutex>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+using namespace math_core;
+using namespace boost::filesystem;
+
+
+namespace point_process_experiment_core {
+
+
+  //=========================================================================
+
+  // Description:
+  // The fixed size header of a snapshot file
+  struct world_snapshot_header_t
+  {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t dimension;
+    uint32_t source_mtime_nsec;
+    uint64_t num_points;
+    uint64_t source_size;
+    int64_t source_mtime;
+  };
+
+  static const char WORLD_SNAPSHOT_MAGIC[8] = { 'P','P','W','O','R','L','D','\0' };
+  static const uint32_t WORLD_SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+  //=========================================================================
+
+  // Description:
+  // The size and modification time (seconds and nanoseconds) of a
+  // file (all 0 if it does not exist). The nanoseconds catch a file
+  // rewritten within the same second at the same size
+  static void
+  source_file_stamp( const std::string& filename,
+		     uint64_t& size,
+		     int64_t& mtime,
+		     uint32_t& mtime_nsec )
+  {
+    size = 0;
+    mtime = 0;
+    mtime_nsec = 0;
+    struct stat st;
+    if( !filename.empty() && ::stat( filename.c_str(), &st ) == 0 ) {
+      size = (uint64_t)st.st_size;
+      mtime = (int64_t)st.st_mtim.tv_sec;
+      mtime_nsec = (uint32_t)st.st_mtim.tv_nsec;
+    }
+  }
+
+  //=========================================================================
+
+  void
+  write_world_snapshot( const std::string& filename,
+			const std::vector<nd_point_t>& points,
+			const nd_aabox_t& window,
+			const std::string& source_filename )
+  {
+    world_snapshot_header_t header;
+    std::memset( &header, 0, sizeof(header) );
+    std::memcpy( header.magic, WORLD_SNAPSHOT_MAGIC, sizeof(header.magic) );
+    header.byte_order = WORLD_SNAPSHOT_BYTE_ORDER;
+    header.version = WORLD_SNAPSHOT_VERSION;
+    header.dimension = window.start.n;
+    header.num_points = points.size();
+    source_file_stamp( source_filename, header.source_size, header.source_mtime, header.source_mtime_nsec );
+
+    // write to a temporary file next to the snapshot and move it into
+    // place once complete
+    std::ostringstream tmp_oss;
+    tmp_oss << filename << ".tmp-" << ::getpid();
+    std::string tmp_filename = tmp_oss.str();
+    {
+      std::ofstream out( tmp_filename.c_str(), std::ios::binary | std::ios::trunc );
+      out.write( (const char*)&header, sizeof(header) );
+      out.write( (const char*)&window.start.coordinate[0], sizeof(double) * header.dimension );
+      out.write( (const char*)&window.end.coordinate[0], sizeof(double) * header.dimension );
+      for( size_t i = 0; i < points.size(); ++i ) {
+	if( points[i].n != (long)header.dimension ) {
+	  out.close();
+	  remove( path( tmp_filename ) );
+	  BOOST_THROW_EXCEPTION( std::domain_error( "Cannot snapshot a world with points of different dimension than its window" ) );
+	}
+	out.write( (const char*)&points[i].coordinate[0], sizeof(double) * header.dimension );
+      }
+      out.flush();
+      if( !out ) {
+	out.close();
+	remove( path( tmp_filename ) );
+	BOOST_THROW_EXCEPTION( invalid_world_snapshot_exception()
+			       << boost::errinfo_file_name( filename ) );
+      }
+    }
+    boost::system::error_code error;
+    rename( path( tmp_filename ), path( filename ), error );
+    if( error ) {
+      remove( path( tmp_filename ), error );
+      BOOST_THROW_EXCEPTION( invalid_world_snapshot_exception()
+			     << boost::errinfo_file_name( filename ) );
+    }
+  }
+
+  //=========================================================================
+
+  world_snapshot_writer_t::world_snapshot_writer_t( const std::string& filename,
+						    const nd_aabox_t& window,
+						    const std::string& source_filename )
+    : _filename( filename ),
+      _dimension( window.start.n ),
+      _size( 0 )
+  {
+    std::ostringstream tmp_oss;
+    tmp_oss << filename << ".tmp-" << ::getpid();
+    _tmp_filename = tmp_oss.str();
+
+    // the header (with no points yet) and the window
+    world_snapshot_header_t header;
+    std::memset( &header, 0, sizeof(header) );
+    std::memcpy( header.magic, WORLD_SNAPSHOT_MAGIC, sizeof(header.magic) );
+    header.byte_order = WORLD_SNAPSHOT_BYTE_ORDER;
+    header.version = WORLD_SNAPSHOT_VERSION;
+    header.dimension = _dimension;
+    header.num_points = 0;
+    source_file_stamp( source_filename, header.source_size, header.source_mtime, header.source_mtime_nsec );
+    _out.open( _tmp_filename.c_str(), std::ios::binary | std::ios::trunc );
+    _out.write( (const char*)&header, sizeof(header) );
+    _out.write( (const char*)&window.start.coordinate[0], sizeof(double) * _dimension );
+    _out.write( (const char*)&window.end.coordinate[0], sizeof(double) * _dimension );
+    if( !_out ) {
+      _out.close();
+      remove( path( _tmp_filename ) );
+      BOOST_THROW_EXCEPTION( invalid_world_snapshot_exception()
+			     << boost::errinfo_file_name( filename ) );
+    }
+  }
+
+  //=========================================================================
+
+  world_snapshot_writer_t::~world_snapshot_writer_t()
+  {
+    // never closed, throw the partial snapshot away
+    if( _out.is_open() ) {
+      _out.close();
+      boost::system::error_code ignored;
+      remove( path( _tmp_filename ), ignored );
+    }
+  }
+
+  //=========================================================================
+
+  void
+  world_snapshot_writer_t::write( const point_batch_t& points )
+  {
+    if( points.size() == 0 ) {
+      return;
+    }
+    if( points.dimension() != _dimension ) {
+      BOOST_THROW_EXCEPTION( std::domain_error( "Cannot snapshot a world with points of different dimension than its window" ) );
+    }
+
+    // the snapshot stores the coordinates of each point together
+    const std::size_t n = points.size();
+    _interleaved.resize( n * _dimension );
+    for( std::size_t d = 0; d < _dimension; ++d ) {
+      const double* x = &points.coordinates[d][0];
+      double* out = &_interleaved[d];
+      for( std::size_t i = 0; i < n; ++i ) {
+	out[ i * _dimension ] = x[i];
+      }
+    }
+    _out.write( (const char*)&_interleaved[0], sizeof(double) * _interleaved.size() );
+    _size += n;
+  }
+
+  //=========================================================================
+
+  void
+  world_snapshot_writer_t::close()
+  {
+    // patch the number of points into the header
+    _out.seekp( offsetof( world_snapshot_header_t, num_points ) );
+    _out.write( (const char*)&_size, sizeof(_size) );
+    _out.flush();
+    bool ok = (bool)_out;
+    _out.close();
+    if( !ok ) {
+      remove( path( _tmp_filename ) );
+      BOOST_THROW_EXCEPTION( invalid_world_snapshot_exception()
+			     << boost::errinfo_file_name( _filename ) );
+    }
+    boost::system::error_code error;
+    rename( path( _tmp_filename ), path( _filename ), error );
+    if( error ) {
+      remove( path( _tmp_filename ), error );
+      BOOST_THROW_EXCEPTION( invalid_world_snapshot_exception()
+			     << boost::errinfo_file_name( _filename ) );
+    }
+  }
+
+  //=========================================================================
+
+  std::size_t
+  world_snapshot_writer_t::size() const
+  {
+    return _size;
+  }
+
+  //=========================================================================
+
+  world_snapshot_t::world_snapshot_t( const std::string& filename )
+    : _filename( filename ),
+      _mapping( NULL ),
+      _mapping_size( 0 ),
+      _dimension( 0 ),
+      _size( 0 ),
+      _source_size( 0 ),
+      _source_mtime( 0 ),
+      _source_mtime_nsec( 0 ),
+      _window( NULL ),
+      _coordinates( NULL )
+  {
+    int fd = ::open( filename.c_str(), O_RDONLY );
+    if( fd < 0 ) {
+      BOOST_THROW_EXCEPTION( invalid_world_snapshot_exception()
+			     << boost::errinfo_file_name( filename ) );
+    }
+    struct stat st;
+    if( ::fstat( fd, &st ) != 0 ||
+	(size_t)st.st_size < sizeof(world_snapshot_header_t) ) {
+      ::close( fd );
+      BOOST_THROW_EXCEPTION( invalid_world_snapshot_exception()
+			     << boost::errinfo_file_name( filename ) );
+    }
+    _mapping_size = st.st_size;
+    _mapping = ::mmap( NULL, _mapping_size, PROT_READ, MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if( _mapping == MAP_FAILED ) {
+      _mapping = NULL;
+      BOOST_THROW_EXCEPTION( invalid_world_snapshot_exception()
+			     << boost::errinfo_file_name( filename ) );
+    }
+
+    // check the header and that the file holds all of the data
+    const world_snapshot_header_t* header = (const world_snapshot_header_t*)_mapping;
+    bool valid = 
+      std::memcmp( header->magic, WORLD_SNAPSHOT_MAGIC, sizeof(header->magic) ) == 0 &&
+      header->byte_order == WORLD_SNAPSHOT_BYTE_ORDER &&
+      header->version == WORLD_SNAPSHOT_VERSION &&
+      header->dimension > 0;
+    if( valid ) {
+      uint64_t needed = sizeof(world_snapshot_header_t) +
+	sizeof(double) * header->dimension * ( 2 + header->num_points );
+      valid = ( needed <= _mapping_size );
+    }
+    if( !valid ) {
+      ::munmap( _mapping, _mapping_size );
+      _mapping = NULL;
+      BOOST_THROW_EXCEPTION( invalid_world_snapshot_exception()
+			     << boost::errinfo_file_name( filename ) );
+    }
+
+    _dimension = header->dimension;
+    _size = header->num_points;
+    _source_size = header->source_size;
+    _source_mtime = header->source_mtime;
+    _source_mtime_nsec = header->source_mtime_nsec;
+    _window = (const double*)( (const char*)_mapping + sizeof(world_snapshot_header_t) );
+    _coordinates = _window + 2 * _dimension;
+  }
+
+  //=========================================================================
+
+  world_snapshot_t::~world_snapshot_t()
+  {
+    if( _mapping ) {
+      ::munmap( _mapping, _mapping_size );
+    }
+  }
+
+  //=========================================================================
+
+  std::size_t
+  world_snapshot_t::size() const
+  {
+    return _size;
+  }
+
+  //=========================================================================
+
+  std::size_t
+  world_snapshot_t::dimension() const
+  {
+    return _dimension;
+  }
+
+  //=========================================================================
+
+  const double*
+  world_snapshot_t::coordinates() const
+  {
+    return _coordinates;
+  }
+
+  //=========================================================================
+
+  nd_point_t
+  world_snapshot_t::point_at( const std::size_t i ) const
+  {
+    const double* c = _coordinates + i * _dimension;
+    return point( std::vector<double>( c, c + _dimension ) );
+  }
+
+  //=========================================================================
+
+  std::vector<nd_point_t>
+  world_snapshot_t::points() const
+  {
+    std::vector<nd_point_t> pts;
+    pts.reserve( _size );
+    for( std::size_t i = 0; i < _size; ++i ) {
+      pts.push_back( point_at( i ) );
+    }
+    return pts;
+  }
+
+  //=========================================================================
+
+  nd_aabox_t
+  world_snapshot_t::window() const
+  {
+    return aabox( point( std::vector<double>( _window, _window + _dimension ) ),
+		  point( std::vector<double>( _window + _dimension, 
+					      _window + 2 * _dimension ) ) );
+  }
+
+  //=========================================================================
+
+  bool
+  world_snapshot_t::is_up_to_date_with( const std::string& source_filename ) const
+  {
+    uint64_t size;
+    int64_t mtime;
+    uint32_t mtime_nsec;
+    source_file_stamp( source_filename, size, mtime, mtime_nsec );
+    return size == _source_size && mtime == _source_mtime &&
+      mtime_nsec == _source_mtime_nsec;
+  }
+
+  //=========================================================================
+
+  // Description:
+  // Shared state of the groundtruth/window functions of a
+  // snapshot cached world. Only the window is kept: the registry
+  // keeps the points it is given, so they are read from the snapshot
+  // (or generated) each time the ground truth is asked for.
+  struct snapshot_cached_world_t
+  {
+    std::string snapshot_filename;
+    std::string source_filename;
+    boost::function<std::vector<nd_point_t> ()> groundtruth;
+    boost::function<nd_aabox_t ()> window;
+
+    std::mutex mutex;
+    bool has_window;
+    nd_aabox_t world_window;
+
+    snapshot_cached_world_t() : has_window( false ) {}
+
+    // Description:
+    // Opens the snapshot if it is there, valid and up to date
+    boost::shared_ptr<world_snapshot_t> open_snapshot() const
+    {
+      if( !exists( path( snapshot_filename ) ) ) {
+	return boost::shared_ptr<world_snapshot_t>();
+      }
+      try {
+	boost::shared_ptr<world_snapshot_t> snapshot( new world_snapshot_t( snapshot_filename ) );
+	if( source_filename.empty() ||
+	    snapshot->is_up_to_date_with( source_filename ) ) {
+	  return snapshot;
+	}
+      } catch( invalid_world_snapshot_exception& ) {
+	// regenerate it
+      }
+      return boost::shared_ptr<world_snapshot_t>();
+    }
+
+    std::vector<nd_point_t> get_groundtruth()
+    {
+      std::lock_guard<std::mutex> lock( mutex );
+      boost::shared_ptr<world_snapshot_t> snapshot = open_snapshot();
+      if( snapshot ) {
+	world_window = snapshot->window();
+	has_window = true;
+	return snapshot->points();
+      }
+
+      // generate the world and snapshot it for next time; a snapshot
+      // which cannot be written (e.g. a read only directory), or a
+      // world whose points are not all of the window's dimension
+      // (which a snapshot cannot hold), only means the next load
+      // generates it again
+      std::vector<nd_point_t> points = groundtruth();
+      world_window = window();
+      has_window = true;
+      for( std::size_t i = 0; i < points.size(); ++i ) {
+	if( points[i].n != world_window.start.n ) {
+	  return points;
+	}
+      }
+      try {
+	write_world_snapshot( snapshot_filename,
+			      points,
+			      world_window,
+			      source_filename );
+      } catch( invalid_world_snapshot_exception& ) {
+      }
+      return points;
+    }
+
+    nd_aabox_t get_window()
+    {
+      std::lock_guard<std::mutex> lock( mutex );
+      if( !has_window ) {
+	boost::shared_ptr<world_snapshot_t> snapshot = open_snapshot();
+	world_window = snapshot ? snapshot->window() : window();
+	has_window = true;
+      }
+      return world_window;
+    }
+  };
+
+  //=========================================================================
+
+  void
+  register_snapshot_cached_world
+  ( const std::string& id,
+    const std::string& snapshot_filename,
+    const boost::function<std::vector<nd_point_t> ()>& groundtruth,
+    const boost::function< nd_aabox_t () >& window,
+    const std::string& source_filename )
+  {
+    boost::shared_ptr<snapshot_cached_world_t> cached( new snapshot_cached_world_t() );
+    cached->snapshot_filename = snapshot_filename;
+    cached->source_filename = source_filename;
+    cached->groundtruth = groundtruth;
+    cached->window = window;
+    register_world( id,
+		    boost::bind( &snapshot_cached_world_t::get_groundtruth, cached ),
+		    boost::bind( &snapshot_cached_world_t::get_window, cached ) );
+  }
+
+  //=========================================================================
+
+  // Description:
+  // Parses the points in an SSV file
+  static std::vector<nd_point_t>
+  parse_points_from_ssv_file( const std::string& filename,
+			      const bool lisp_format )
+  {
+    std::ifstream in( filename.c_str() );
+    if( !in ) {
+      BOOST_THROW_EXCEPTION( std::runtime_error( "Unable to open SSV file: " + filename ) );
+    }
+    return parse_points_from_ssv_stream( in, lisp_format );
+  }
+
+  //=========================================================================
+
+  void
+  register_ssv_world
+  ( const std::string& id,
+    const std::string& ssv_filename,
+    const bool lisp_format,
+    const boost::function< nd_aabox_t () >& window )
+  {
+    register_snapshot_cached_world( id,
+				    ssv_filename + ".snapshot",
+				    boost::bind( &parse_points_from_ssv_file,
+						 ssv_filename,
+						 lisp_format ),
+				    window,
+				    ssv_filename );
+  }
+
+  //=========================================================================
+
+}
@@ -0,0 +1,211 @@
+
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_world_snapshot_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_world_snapshot_HPP__
+
+#include "point_batch.hpp"
+#include <math-core/types.hpp>
+#include <boost/function.hpp>
+#include <boost/exception/all.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstddef>
+#include <stdint.h>
+
+namespace point_process_experiment_core {
+
+
+  // Description:
+  // Exception thrown when a world snapshot file cannot be read
+  // (missing, truncated, wrong magic/version/byte order).
+  // Carries a boost::errinfo_file_name
+  struct invalid_world_snapshot_exception : public virtual std::exception,
+					    public virtual boost::exception
+  {
+  };
+
+
+  // Description:
+  // The current world snapshot format version.
+  //
+  // A snapshot file is (native byte order):
+  //   char[8]   magic "PPWORLD"
+  //   uint32_t  byte order mark (0x01020304)
+  //   uint32_t  version
+  //   uint32_t  dimension
+  //   uint32_t  nanoseconds of the source file's modification time
+  //             (0 if none; version 1 only had whole seconds)
+  //   uint64_t  number of points
+  //   uint64_t  size of the source file (0 if none)
+  //   int64_t   modification time of the source file in seconds
+  //             (0 if none)
+  //   double[dimension]  window start
+  //   double[dimension]  window end
+  //   double[number of points * dimension]  point coordinates
+  // so the coordinates are 8-byte aligned and can be used directly
+  // from a memory mapping.
+  const uint32_t WORLD_SNAPSHOT_VERSION = 2;
+
+
+  // Description:
+  // Writes a snapshot of the given points and window.
+  // All points must have the dimension of the window.
+  // If a source file is given, its size and modification time are
+  // recorded so stale snapshots can be detected.
+  // The snapshot is written to a temporary file and then renamed, so
+  // readers never see a partial snapshot.
+  // Throws invalid_world_snapshot_exception if it cannot be written
+  // or moved into place.
+  void
+  write_world_snapshot( const std::string& filename,
+			const std::vector<math_core::nd_point_t>& points,
+			const math_core::nd_aabox_t& window,
+			const std::string& source_filename = "" );
+
+
+  // Description:
+  // Writes a snapshot a batch of points at a time, so a world can be
+  // streamed into its snapshot without ever being held in memory.
+  // As with write_world_snapshot, the snapshot is written to a
+  // temporary file which close() moves into place (a writer which is
+  // never closed leaves no snapshot behind).
+  class world_snapshot_writer_t
+  {
+  public:
+
+    world_snapshot_writer_t( const std::string& filename,
+			     const math_core::nd_aabox_t& window,
+			     const std::string& source_filename = "" );
+
+    ~world_snapshot_writer_t();
+
+    // Description:
+    // Appends the points of the batch, which must have the dimension
+    // of the window
+    void write( const point_batch_t& points );
+
+    // Description:
+    // Writes the number of points into the header and moves the
+    // snapshot into place (throws invalid_world_snapshot_exception
+    // if either fails)
+    void close();
+
+    // Description:
+    // The number of points written so far
+    std::size_t size() const;
+
+  protected:
+
+    std::string _filename;
+    std::string _tmp_filename;
+    std::ofstream _out;
+    std::size_t _dimension;
+    uint64_t _size;
+    std::vector<double> _interleaved;
+
+  private:
+    world_snapshot_writer_t( const world_snapshot_writer_t& );
+    world_snapshot_writer_t& operator= ( const world_snapshot_writer_t& );
+  };
+
+
+  // Description:
+  // A read-only memory mapping of a world snapshot file.
+  // The coordinates are used in place (no parsing and no copy) until
+  // points are asked for as nd_point_t.
+  class world_snapshot_t
+  {
+  public:
+
+    // Description:
+    // Maps the given snapshot file.
+    // Throws invalid_world_snapshot_exception if it is not a valid
+    // snapshot of the current version
+    explicit world_snapshot_t( const std::string& filename );
+
+    ~world_snapshot_t();
+
+    // Description:
+    // The number of points
+    std::size_t size() const;
+
+    // Description:
+    // The dimension of the points (and window)
+    std::size_t dimension() const;
+
+    // Description:
+    // The point coordinates, size() * dimension() doubles with the
+    // coordinates of each point stored together
+    const double* coordinates() const;
+
+    // Description:
+    // The i-th point
+    math_core::nd_point_t point_at( const std::size_t i ) const;
+
+    // Description:
+    // All of the points
+    std::vector<math_core::nd_point_t> points() const;
+
+    // Description:
+    // The window
+    math_core::nd_aabox_t window() const;
+
+    // Description:
+    // Returns true iff the snapshot was made from the given source file
+    // as it is now (same size and modification time, to the
+    // nanosecond)
+    bool is_up_to_date_with( const std::string& source_filename ) const;
+
+  protected:
+
+    std::string _filename;
+    void* _mapping;
+    std::size_t _mapping_size;
+    std::size_t _dimension;
+    std::size_t _size;
+    uint64_t _source_size;
+    int64_t _source_mtime;
+    uint32_t _source_mtime_nsec;
+    const double* _window;
+    const double* _coordinates;
+
+  private:
+    world_snapshot_t( const world_snapshot_t& );
+    world_snapshot_t& operator= ( const world_snapshot_t& );
+  };
+
+
+  // Description:
+  // Registers a world (see register_world) whose ground truth and
+  // window are read from the given snapshot file when it exists and
+  // is valid (and up to date with source_filename, if given).
+  // Otherwise the given functions are used and a snapshot is written
+  // for next time (if it cannot be written, e.g. in a read only
+  // directory, or the points are not all of the window's dimension,
+  // the generated world is still used).
+  // Only the window is kept in memory; the points are handed to the
+  // registry, which caches them.
+  void
+  register_snapshot_cached_world
+  ( const std::string& id,
+    const std::string& snapshot_filename,
+    const boost::function<std::vector<math_core::nd_point_t> ()>& groundtruth,
+    const boost::function< math_core::nd_aabox_t () >& window,
+    const std::string& source_filename = "" );
+
+
+  // Description:
+  // Registers a world whose ground truth is parsed from an SSV file
+  // (see parse_points_from_ssv_stream), cached as a snapshot next to
+  // the file (<ssv_filename>.snapshot) so only the first load parses.
+  void
+  register_ssv_world
+  ( const std::string& id,
+    const std::string& ssv_filename,
+    const bool lisp_format,
+    const boost::function< math_core::nd_aabox_t () >& window );
+
+}
+
+#endif
@@ -0,0 +1,631 @@
+
+// Microbenchmarks for the kernels the experiment core depends on:
+//   compute_empty_regions, parse_points_from_ssv_stream,
+//   grid cell point queries (point_index_t vs. a linear scan)
+//   and the simulated data generators.
+//
+// Usage:
+//   benchmark-experiment-core [--format csv|json] [--output <file>]
+//                             [--repetitions <n>] [--quick]
+//                             [--baseline <csv> [--threshold <fraction>]]
+//
+// Results (one row per benchmark) are written as CSV or JSON.
+// With --baseline, the best time of each benchmark is compared to
+// the one in a previous CSV result file, and any benchmark slower than
+// baseline * (1 + threshold) is reported as a regression (and the
+// program exits with status 1).
+
+#include <point-process-experiment-core/geometry.hpp>
+#include <point-process-experiment-core/data_io.hpp>
+#include <point-process-experiment-core/point_index.hpp>
+#include <point-process-experiment-core/simulated_data.hpp>
+#include <point-process-experiment-core/cluster_process.hpp>
+#include <point-process-experiment-core/phase_timing.hpp>
+#include <math-core/geom.hpp>
+#include <math-core/io.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+using namespace math_core;
+using namespace point_process_experiment_core;
+
+
+//========================================================================
+
+// Description:
+// The timing of a single benchmark
+struct benchmark_result_t
+{
+  std::string name;
+  std::string parameters;
+  std::size_t items;
+  std::size_t repetitions;
+  double min_seconds;
+  double mean_seconds;
+};
+
+// Description:
+// Something for benchmarks to write results into so that the
+// compiler can not throw the work away
+static volatile std::size_t _g_sink = 0;
+
+// fixed seed so every run benchmarks the same inputs
+static std::mt19937 _g_rng( 20140101 );
+
+//========================================================================
+
+// Description:
+// Runs a benchmark the given number of times and returns its timing.
+// items is the number of things processed per run (points, lines,
+// queries...) used for the per-item rates.
+benchmark_result_t
+run_benchmark( const std::string& name,
+	       const std::string& parameters,
+	       const std::size_t items,
+	       const std::size_t repetitions,
+	       const boost::function<void ()>& body )
+{
+  benchmark_result_t result;
+  result.name = name;
+  result.parameters = parameters;
+  result.items = items;
+  result.repetitions = std::max( repetitions, (std::size_t)1 );
+  result.min_seconds = 0;
+  result.mean_seconds = 0;
+  double total = 0;
+  for( std::size_t r = 0; r < result.repetitions; ++r ) {
+    stopwatch_t watch;
+    body();
+    double s = watch.elapsed();
+    total += s;
+    if( r == 0 || s < result.min_seconds ) {
+      result.min_seconds = s;
+    }
+  }
+  result.mean_seconds = total / result.repetitions;
+  std::cerr << "  " << name << " [" << parameters << "] "
+	    << result.min_seconds << "s" << std::endl;
+  return result;
+}
+
+//========================================================================
+
+// Description:
+// n uniformly random points inside a window
+std::vector<nd_point_t>
+uniform_points( const std::size_t n,
+		const nd_aabox_t& window )
+{
+  std::vector<nd_point_t> points;
+  points.reserve( n );
+  for( std::size_t i = 0; i < n; ++i ) {
+    nd_point_t p = window.start;
+    for( long d = 0; d < window.n; ++d ) {
+      std::uniform_real_distribution<double> u( window.start.coordinate[d],
+						window.end.coordinate[d] );
+      p.coordinate[d] = u( _g_rng );
+    }
+    points.push_back( p );
+  }
+  return points;
+}
+
+//========================================================================
+
+// Description:
+// n points in a few tight gaussian clusters inside a window
+std::vector<nd_point_t>
+clustered_points( const std::size_t n,
+		  const nd_aabox_t& window,
+		  const std::size_t num_clusters )
+{
+  std::vector<nd_point_t> centers = uniform_points( num_clusters, window );
+  std::vector<nd_point_t> points;
+  points.reserve( n );
+  std::normal_distribution<double> noise( 0.0, 1.0 );
+  while( points.size() < n ) {
+    nd_point_t p = centers[ points.size() % num_clusters ];
+    for( long d = 0; d < window.n; ++d ) {
+      double spread = 0.01 * ( window.end.coordinate[d] - window.start.coordinate[d] );
+      p.coordinate[d] += spread * noise( _g_rng );
+    }
+    if( is_inside( p, window ) ) {
+      points.push_back( p );
+    }
+  }
+  return points;
+}
+
+//========================================================================
+
+// Description:
+// A unit window of the given dimension scaled by size
+nd_aabox_t
+window_of( const std::size_t dim, const double size )
+{
+  std::vector<double> start( dim, 0.0 ), end( dim, size );
+  return aabox( point( start ), point( end ) );
+}
+
+//========================================================================
+
+// Description:
+// An SSV text with n 2D points printed with the given significant
+// digits (17 round trips a double exactly). In lisp format numbers
+// end in d0
+std::string
+ssv_text( const std::size_t n, const bool lisp_format, const int digits )
+{
+  std::vector<nd_point_t> points = uniform_points( n, window_of( 2, 1000.0 ) );
+  std::ostringstream oss;
+  oss.precision( digits );
+  for( std::size_t i = 0; i < points.size(); ++i ) {
+    for( long d = 0; d < points[i].n; ++d ) {
+      if( d > 0 ) {
+	oss << " ";
+      }
+      oss << points[i].coordinate[d];
+      if( lisp_format ) {
+	oss << "d0";
+      }
+    }
+    oss << "\n";
+  }
+  return oss.str();
+}
+
+//========================================================================
+
+void bench_empty_regions( const std::vector<nd_point_t>& points,
+			  const nd_aabox_t& region )
+{
+  _g_sink += compute_empty_regions( points, region ).size();
+}
+
+void bench_parse( const std::string& text, const bool lisp_format )
+{
+  std::istringstream iss( text );
+  _g_sink += parse_points_from_ssv_stream( iss, lisp_format ).size();
+}
+
+void bench_index_queries( const std::vector<nd_point_t>& points,
+			  const std::vector<nd_aabox_t>& queries,
+			  const std::vector<double>& cell_size )
+{
+  point_index_t index( points, cell_size );
+  for( std::size_t i = 0; i < queries.size(); ++i ) {
+    _g_sink += index.indices_inside( queries[i] ).size();
+  }
+}
+
+void bench_linear_queries( const std::vector<nd_point_t>& points,
+			   const std::vector<nd_aabox_t>& queries )
+{
+  for( std::size_t i = 0; i < queries.size(); ++i ) {
+    _g_sink += points_inside_window( queries[i], points ).size();
+  }
+}
+
+void bench_line_clusters( const nd_aabox_t& window,
+			  const std::size_t num_clusters )
+{
+  _g_sink +=
+    simulate_line_point_clusters_gaussian_spread_poisson_size( window,
+							       num_clusters,
+							       5.0,
+							       10.0 ).size();
+}
+
+void bench_cluster_batch( const nd_aabox_t& window,
+			  const std::vector<std::size_t>& clusters_per_dimension )
+{
+  rng_stream_t rng( 20140101 );
+  point_batch_t centers = lattice_cluster_centers( window, clusters_per_dimension );
+  _g_sink +=
+    simulate_point_clusters_gaussian_spread_poisson_size( window,
+							  centers,
+							  5.0,
+							  10.0,
+							  rng ).size();
+}
+
+void bench_cluster_process( const nd_aabox_t& window,
+			    const cluster_process_t& process )
+{
+  cell_point_buckets_t buckets( window, std::vector<double>( window.start.n, 10.0 ) );
+  _g_sink += generate_cluster_process( window,
+				       process,
+				       rng_stream_t( 20140101 ),
+				       boost::bind( &cell_point_buckets_t::add, &buckets, _1 ) );
+}
+
+void bench_noise( const std::vector<nd_point_t>& points,
+		  const nd_aabox_t& window )
+{
+  std::vector<nd_point_t> noisy = points;
+  add_zero_mean_coordinate_independent_gaussian_noise( noisy, 1.0, window );
+  _g_sink += noisy.size();
+}
+
+void bench_truncated_noise( const std::vector<nd_point_t>& points,
+			    const nd_aabox_t& window )
+{
+  rng_stream_t rng( 20140101 );
+  std::vector<nd_point_t> noisy = points;
+  add_zero_mean_coordinate_independent_gaussian_noise( noisy, 1.0, window, rng );
+  _g_sink += noisy.size();
+}
+
+//========================================================================
+
+// Description:
+// Random grid-cell-sized query regions over a window
+std::vector<nd_aabox_t>
+cell_queries( const nd_aabox_t& window,
+	      const double cell_size,
+	      const std::size_t n )
+{
+  std::vector<nd_aabox_t> queries;
+  std::vector<nd_point_t> corners = uniform_points( n, window );
+  for( std::size_t i = 0; i < corners.size(); ++i ) {
+    nd_point_t start = corners[i];
+    nd_point_t end = corners[i];
+    for( long d = 0; d < window.n; ++d ) {
+      start.coordinate[d] = cell_size * std::floor( start.coordinate[d] / cell_size );
+      end.coordinate[d] = start.coordinate[d] + cell_size;
+    }
+    queries.push_back( aabox( start, end ) );
+  }
+  return queries;
+}
+
+//========================================================================
+
+std::string
+parameters_string( const std::string& a, const std::size_t n )
+{
+  std::ostringstream oss;
+  oss << a << " n=" << n;
+  return oss.str();
+}
+
+//========================================================================
+
+std::vector<benchmark_result_t>
+run_all_benchmarks( const std::size_t repetitions,
+		    const bool quick )
+{
+  std::vector<benchmark_result_t> results;
+  std::size_t scale = quick ? 10 : 1;
+
+  // compute_empty_regions
+  std::size_t empty_sizes[] = { 10, 100, 1000, 10000 };
+  for( std::size_t k = 0; k < 4; ++k ) {
+    std::size_t n = empty_sizes[k] / ( k > 1 ? scale : 1 );
+    nd_aabox_t region = window_of( 2, 10.0 );
+    std::vector<nd_point_t> uniform = uniform_points( n, region );
+    std::vector<nd_point_t> clustered = clustered_points( n, region, 3 );
+    results.push_back( run_benchmark( "compute_empty_regions",
+				      parameters_string( "2d uniform", n ),
+				      n, repetitions,
+				      boost::bind( &bench_empty_regions,
+						   boost::cref( uniform ),
+						   boost::cref( region ) ) ) );
+    results.push_back( run_benchmark( "compute_empty_regions",
+				      parameters_string( "2d clustered", n ),
+				      n, repetitions,
+				      boost::bind( &bench_empty_regions,
+						   boost::cref( clustered ),
+						   boost::cref( region ) ) ) );
+    if( n <= 1000 ) {
+      nd_aabox_t region3 = window_of( 3, 10.0 );
+      std::vector<nd_point_t> uniform3 = uniform_points( n, region3 );
+      results.push_back( run_benchmark( "compute_empty_regions",
+					parameters_string( "3d uniform", n ),
+					n, repetitions,
+					boost::bind( &bench_empty_regions,
+						     boost::cref( uniform3 ),
+						     boost::cref( region3 ) ) ) );
+    }
+  }
+
+  // parse_points_from_ssv_stream, with full (17 digit) precision
+  // numbers which need the correctly rounded path and short ones which
+  // do not
+  std::size_t parse_sizes[] = { 1000, 100000, 1000000 };
+  int parse_digits[] = { 17, 6 };
+  for( std::size_t k = 0; k < 3; ++k ) {
+    std::size_t n = parse_sizes[k] / ( k > 0 ? scale : 1 );
+    for( int lisp = 0; lisp < 2; ++lisp ) {
+      for( int j = 0; j < 2; ++j ) {
+	std::string text = ssv_text( n, lisp == 1, parse_digits[j] );
+	std::ostringstream kind;
+	kind << ( lisp ? "lisp" : "plain" ) << " " << parse_digits[j] << " digits";
+	results.push_back( run_benchmark( "parse_points_from_ssv_stream",
+					  parameters_string( kind.str(), n ),
+					  n, repetitions,
+					  boost::bind( &bench_parse,
+						       boost::cref( text ),
+						       lisp == 1 ) ) );
+      }
+    }
+  }
+
+  // grid cell queries (100x100 cells)
+  std::size_t query_sizes[] = { 1000, 100000 };
+  for( std::size_t k = 0; k < 2; ++k ) {
+    std::size_t n = query_sizes[k] / ( k > 0 ? scale : 1 );
+    std::size_t num_queries = 1000;
+    nd_aabox_t window = window_of( 2, 100.0 );
+    std::vector<double> cell_size( 2, 1.0 );
+    std::vector<nd_point_t> points = uniform_points( n, window );
+    std::vector<nd_aabox_t> queries = cell_queries( window, 1.0, num_queries );
+    results.push_back( run_benchmark( "cell_query_point_index",
+				      parameters_string( "2d 1000 queries (incl. build)", n ),
+				      num_queries, repetitions,
+				      boost::bind( &bench_index_queries,
+						   boost::cref( points ),
+						   boost::cref( queries ),
+						   boost::cref( cell_size ) ) ) );
+    results.push_back( run_benchmark( "cell_query_linear_scan",
+				      parameters_string( "2d 1000 queries", n ),
+				      num_queries, repetitions,
+				      boost::bind( &bench_linear_queries,
+						   boost::cref( points ),
+						   boost::cref( queries ) ) ) );
+  }
+
+  // simulated data generators
+  std::size_t cluster_counts[] = { 10, 100, 1000 };
+  for( std::size_t k = 0; k < 3; ++k ) {
+    std::size_t n = cluster_counts[k] / ( k > 1 ? scale : 1 );
+    nd_aabox_t window = window_of( 1, 1000.0 );
+    results.push_back( run_benchmark( "simulate_line_point_clusters",
+				      parameters_string( "clusters", n ),
+				      n, repetitions,
+				      boost::bind( &bench_line_clusters,
+						   window,
+						   n ) ) );
+  }
+  for( std::size_t k = 0; k < 3; ++k ) {
+    std::size_t n = cluster_counts[k] / ( k > 1 ? scale : 1 );
+    nd_aabox_t window = window_of( 1, 1000.0 );
+    results.push_back( run_benchmark( "simulate_point_clusters_batch",
+				      parameters_string( "1d clusters", n ),
+				      n, repetitions,
+				      boost::bind( &bench_cluster_batch,
+						   window,
+						   std::vector<std::size_t>( 1, n ) ) ) );
+  }
+  {
+    std::size_t n = 100 / scale;
+    nd_aabox_t window = window_of( 2, 1000.0 );
+    results.push_back( run_benchmark( "simulate_point_clusters_batch",
+				      parameters_string( "2d clusters", n * n ),
+				      n * n, repetitions,
+				      boost::bind( &bench_cluster_batch,
+						   window,
+						   std::vector<std::size_t>( 2, n ) ) ) );
+  }
+  std::size_t parent_counts[] = { 100, 10000 };
+  for( std::size_t k = 0; k < 2; ++k ) {
+    std::size_t n = parent_counts[k] / ( k > 0 ? scale : 1 );
+    nd_aabox_t window = window_of( 2, 1000.0 );
+    cluster_process_t process;
+    process.parent_intensity = n / ( 1000.0 * 1000.0 );
+    process.mean_cluster_size = 100;
+    process.scale = 5.0;
+    process.tile_size = 100.0;
+    results.push_back( run_benchmark( "generate_thomas_process",
+				      parameters_string( "2d tiled parents", n ),
+				      n, repetitions,
+				      boost::bind( &bench_cluster_process,
+						   window,
+						   process ) ) );
+  }
+  std::size_t noise_sizes[] = { 1000, 100000 };
+  for( std::size_t k = 0; k < 2; ++k ) {
+    std::size_t n = noise_sizes[k] / ( k > 0 ? scale : 1 );
+    nd_aabox_t window = window_of( 2, 100.0 );
+    std::vector<nd_point_t> points = uniform_points( n, window );
+    results.push_back( run_benchmark( "add_gaussian_noise",
+				      parameters_string( "2d", n ),
+				      n, repetitions,
+				      boost::bind( &bench_noise,
+						   boost::cref( points ),
+						   boost::cref( window ) ) ) );
+    results.push_back( run_benchmark( "add_truncated_gaussian_noise",
+				      parameters_string( "2d", n ),
+				      n, repetitions,
+				      boost::bind( &bench_truncated_noise,
+						   boost::cref( points ),
+						   boost::cref( window ) ) ) );
+  }
+
+  return results;
+}
+
+//========================================================================
+
+// Description:
+// CSV fields are quoted since parameters contain spaces
+std::string
+quoted( const std::string& s )
+{
+  return "\"" + s + "\"";
+}
+
+void
+write_csv( std::ostream& out, const std::vector<benchmark_result_t>& results )
+{
+  out.precision( 9 );
+  out << "name,parameters,items,repetitions,min_seconds,mean_seconds,items_per_second" << std::endl;
+  for( std::size_t i = 0; i < results.size(); ++i ) {
+    const benchmark_result_t& r = results[i];
+    out << quoted( r.name ) << ","
+	<< quoted( r.parameters ) << ","
+	<< r.items << ","
+	<< r.repetitions << ","
+	<< r.min_seconds << ","
+	<< r.mean_seconds << ","
+	<< ( r.min_seconds > 0 ? r.items / r.min_seconds : 0 ) << std::endl;
+  }
+}
+
+void
+write_json( std::ostream& out, const std::vector<benchmark_result_t>& results )
+{
+  out.precision( 9 );
+  out << "[" << std::endl;
+  for( std::size_t i = 0; i < results.size(); ++i ) {
+    const benchmark_result_t& r = results[i];
+    out << "  { \"name\": " << quoted( r.name )
+	<< ", \"parameters\": " << quoted( r.parameters )
+	<< ", \"items\": " << r.items
+	<< ", \"repetitions\": " << r.repetitions
+	<< ", \"min_seconds\": " << r.min_seconds
+	<< ", \"mean_seconds\": " << r.mean_seconds
+	<< ", \"items_per_second\": " << ( r.min_seconds > 0 ? r.items / r.min_seconds : 0 )
+	<< " }" << ( i + 1 < results.size() ? "," : "" ) << std::endl;
+  }
+  out << "]" << std::endl;
+}
+
+//========================================================================
+
+// Description:
+// Reads the min_seconds of each (name,parameters) from a CSV written
+// by write_csv
+std::map<std::string,double>
+read_baseline( std::istream& in )
+{
+  std::map<std::string,double> baseline;
+  std::string line;
+  std::getline( in, line ); // header
+  while( std::getline( in, line ) ) {
+    std::vector<std::string> fields;
+    std::string field;
+    bool in_quotes = false;
+    for( std::size_t i = 0; i < line.size(); ++i ) {
+      if( line[i] == '"' ) {
+	in_quotes = !in_quotes;
+      } else if( line[i] == ',' && !in_quotes ) {
+	fields.push_back( field );
+	field.clear();
+      } else {
+	field += line[i];
+      }
+    }
+    fields.push_back( field );
+    if( fields.size() >= 5 ) {
+      baseline[ fields[0] + " [" + fields[1] + "]" ] = std::atof( fields[4].c_str() );
+    }
+  }
+  return baseline;
+}
+
+//========================================================================
+
+void
+usage()
+{
+  std::cerr << "usage: benchmark-experiment-core [--format csv|json] [--output <file>]" << std::endl
+	    << "                                 [--repetitions <n>] [--quick]" << std::endl
+	    << "                                 [--baseline <csv> [--threshold <fraction>]]" << std::endl;
+}
+
+//========================================================================
+
+int main( int argc, char** argv )
+{
+
+  std::string format = "csv";
+  std::string output_filename;
+  std::string baseline_filename;
+  double threshold = 0.2;
+  std::size_t repetitions = 5;
+  bool quick = false;
+
+  // parse the arguments
+  for( int i = 1; i < argc; ++i ) {
+    std::string arg = argv[i];
+    bool has_value = ( i + 1 < argc );
+    if( arg == "--format" && has_value ) {
+      format = argv[++i];
+    } else if( arg == "--output" && has_value ) {
+      output_filename = argv[++i];
+    } else if( arg == "--baseline" && has_value ) {
+      baseline_filename = argv[++i];
+    } else if( arg == "--threshold" && has_value ) {
+      threshold = std::atof( argv[++i] );
+    } else if( arg == "--repetitions" && has_value ) {
+      repetitions = std::strtoul( argv[++i], NULL, 10 );
+    } else if( arg == "--quick" ) {
+      quick = true;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if( format != "csv" && format != "json" ) {
+    usage();
+    return 2;
+  }
+
+  // run the benchmarks
+  std::vector<benchmark_result_t> results
+    = run_all_benchmarks( repetitions, quick );
+
+  // write out the results
+  std::ofstream out_file;
+  if( !output_filename.empty() ) {
+    out_file.open( output_filename.c_str() );
+  }
+  std::ostream& out = output_filename.empty() ? std::cout : out_file;
+  if( format == "json" ) {
+    write_json( out, results );
+  } else {
+    write_csv( out, results );
+  }
+
+  // compare against the baseline
+  if( !baseline_filename.empty() ) {
+    std::ifstream in( baseline_filename.c_str() );
+    if( !in ) {
+      std::cerr << "could not read baseline " << baseline_filename << std::endl;
+      return 2;
+    }
+    std::map<std::string,double> baseline = read_baseline( in );
+    std::size_t num_regressions = 0;
+    for( std::size_t i = 0; i < results.size(); ++i ) {
+      std::string key = results[i].name + " [" + results[i].parameters + "]";
+      std::map<std::string,double>::const_iterator it = baseline.find( key );
+      if( it == baseline.end() ) {
+	continue;
+      }
+      if( results[i].min_seconds > it->second * ( 1.0 + threshold ) ) {
+	std::cerr << "REGRESSION: " << key << " "
+		  << results[i].min_seconds << "s (baseline "
+		  << it->second << "s)" << std::endl;
+	++num_regressions;
+      }
+    }
+    std::cerr << num_regressions << " regression(s) (threshold "
+	      << threshold << ")" << std::endl;
+    if( num_regressions > 0 ) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
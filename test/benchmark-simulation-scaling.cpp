@@ -0,0 +1,299 @@
+
+// End-to-end scaling benchmark of the experiment harness.
+//
+// Runs setup_planner_with_initial_observations and
+// simulate_run_until_all_points_found with the deterministic stub
+// planner/model (see stub_planner.hpp) over uniform synthetic 2D worlds
+// of different numbers of points and grid cells, so that the time and
+// memory measured is that of the harness, not the model.
+//
+// Usage:
+//   benchmark-simulation-scaling [--points n,n,...] [--cells n,n,...]
+//                                [--order raster|random]
+//                                [--trace-level off|summary|sampled|full]
+//                                [--cells-per-step <k>]
+//                                [--format csv|json] [--output <file>]
+//
+// The traces are formatted as usual but discarded.
+// Memory is the peak resident set size of the process, so the growth
+// reported for a run is how much it raised the peak (runs go from the
+// smallest world to the largest).
+
+#include "stub_planner.hpp"
+#include <point-process-experiment-core/experiment_utils.hpp>
+#include <point-process-experiment-core/phase_timing.hpp>
+#include <math-core/geom.hpp>
+#include <math-core/io.hpp>
+#include <sys/resource.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+
+using namespace math_core;
+using namespace point_process_core;
+using namespace planner_core;
+using namespace point_process_experiment_core;
+using namespace stub_planner;
+
+
+//========================================================================
+
+// Description:
+// A stream buffer which throws away everything written to it
+// (after it has been formatted)
+class null_buffer_t : public std::streambuf
+{
+public:
+  null_buffer_t() { setp( _buffer, _buffer + sizeof( _buffer ) ); }
+protected:
+  virtual int overflow( int c )
+  {
+    setp( _buffer, _buffer + sizeof( _buffer ) );
+    return traits_type::not_eof( c );
+  }
+  char _buffer[ 4096 ];
+};
+
+//========================================================================
+
+// Description:
+// The result of one scaling run
+struct scaling_result_t
+{
+  std::size_t num_points;
+  std::size_t num_cells;
+  std::size_t iterations;
+  double setup_seconds;
+  double simulation_seconds;
+  long peak_rss_kb;
+  long rss_growth_kb;
+};
+
+//========================================================================
+
+// Description:
+// The peak resident set size so far, in KB
+long
+peak_rss_kb()
+{
+  struct rusage usage;
+  getrusage( RUSAGE_SELF, &usage );
+  return usage.ru_maxrss;
+}
+
+//========================================================================
+
+std::vector<std::size_t>
+parse_sizes( const std::string& list )
+{
+  std::vector<std::size_t> sizes;
+  std::istringstream iss( list );
+  std::string item;
+  while( std::getline( iss, item, ',' ) ) {
+    sizes.push_back( (std::size_t)std::atof( item.c_str() ) );
+  }
+  return sizes;
+}
+
+//========================================================================
+
+scaling_result_t
+run_scaling( const std::size_t num_points,
+	     const std::size_t num_cells,
+	     const visit_order_t order,
+	     const trace_level_t trace_level,
+	     const std::size_t cells_per_step )
+{
+  scaling_result_t result;
+  result.num_points = num_points;
+  result.num_cells = num_cells;
+
+  // a uniform world (square grid of ~num_cells cells)
+  const double size = 1000.0;
+  nd_aabox_t window = aabox( point( 0.0, 0.0 ), point( size, size ) );
+  double cell_size = size / std::max( 1.0, std::floor( std::sqrt( (double)num_cells ) ) );
+  std::mt19937 rng( 42 );
+  std::uniform_real_distribution<double> u( 0.0, size );
+  std::vector<nd_point_t> ground_truth;
+  ground_truth.reserve( num_points );
+  for( std::size_t i = 0; i < num_points; ++i ) {
+    ground_truth.push_back( point( u( rng ), u( rng ) ) );
+  }
+
+  boost::shared_ptr<mcmc_point_process_t> process
+    ( new stub_point_process_t( window ) );
+  boost::shared_ptr<grid_planner_t> planner
+    ( new stub_grid_planner_t( process, cell_size, order, 42 ) );
+
+  long rss_before = peak_rss_kb();
+
+  // seed with the bottom-left 10% of the world
+  stopwatch_t watch;
+  nd_aabox_t initial_window = aabox( point( 0.0, 0.0 ),
+				     point( size * std::sqrt( 0.1 ),
+					    size * std::sqrt( 0.1 ) ) );
+  initial_window =
+    setup_planner_with_initial_observations( planner,
+					     true,
+					     initial_window,
+					     ground_truth );
+  result.setup_seconds = watch.lap();
+
+  // run to the end, discarding the traces
+  null_buffer_t null_buffer;
+  std::ostream out_meta( &null_buffer );
+  std::ostream out_trace( &null_buffer );
+  std::ostream out_progress( &null_buffer );
+  std::ostream out_verbose_trace( &null_buffer );
+  simulation_options_t options;
+  options.verbose_trace_level = trace_level;
+  options.trace_sample_period = 100;
+  options.cells_per_step = cells_per_step;
+  std::vector<marked_grid_cell_t> cells =
+    simulate_run_until_all_points_found( planner,
+					 true,
+					 initial_window,
+					 1.0,
+					 ground_truth,
+					 out_meta,
+					 out_trace,
+					 out_progress,
+					 out_verbose_trace,
+					 options );
+  result.simulation_seconds = watch.lap();
+  result.iterations = cells.size();
+  result.peak_rss_kb = peak_rss_kb();
+  result.rss_growth_kb = result.peak_rss_kb - rss_before;
+  return result;
+}
+
+//========================================================================
+
+void
+write_results( std::ostream& out,
+	       const std::vector<scaling_result_t>& results,
+	       const bool json )
+{
+  out.precision( 9 );
+  if( json ) {
+    out << "[" << std::endl;
+  } else {
+    out << "points,cells,iterations,setup_seconds,simulation_seconds,seconds_per_iteration,peak_rss_kb,rss_growth_bytes_per_iteration" << std::endl;
+  }
+  for( std::size_t i = 0; i < results.size(); ++i ) {
+    const scaling_result_t& r = results[i];
+    std::size_t iterations = std::max( r.iterations, (std::size_t)1 );
+    double per_iteration = r.simulation_seconds / iterations;
+    double bytes_per_iteration = 1024.0 * r.rss_growth_kb / iterations;
+    if( json ) {
+      out << "  { \"points\": " << r.num_points
+	  << ", \"cells\": " << r.num_cells
+	  << ", \"iterations\": " << r.iterations
+	  << ", \"setup_seconds\": " << r.setup_seconds
+	  << ", \"simulation_seconds\": " << r.simulation_seconds
+	  << ", \"seconds_per_iteration\": " << per_iteration
+	  << ", \"peak_rss_kb\": " << r.peak_rss_kb
+	  << ", \"rss_growth_bytes_per_iteration\": " << bytes_per_iteration
+	  << " }" << ( i + 1 < results.size() ? "," : "" ) << std::endl;
+    } else {
+      out << r.num_points << ","
+	  << r.num_cells << ","
+	  << r.iterations << ","
+	  << r.setup_seconds << ","
+	  << r.simulation_seconds << ","
+	  << per_iteration << ","
+	  << r.peak_rss_kb << ","
+	  << bytes_per_iteration << std::endl;
+    }
+  }
+  if( json ) {
+    out << "]" << std::endl;
+  }
+}
+
+//========================================================================
+
+void
+usage()
+{
+  std::cerr << "usage: benchmark-simulation-scaling [--points n,n,...] [--cells n,n,...]" << std::endl
+	    << "         [--order raster|random] [--trace-level off|summary|sampled|full]" << std::endl
+	    << "         [--cells-per-step <k>] [--format csv|json] [--output <file>]" << std::endl;
+}
+
+//========================================================================
+
+int main( int argc, char** argv )
+{
+
+  std::vector<std::size_t> point_counts = parse_sizes( "1e3,1e4,1e5,1e6" );
+  std::vector<std::size_t> cell_counts = parse_sizes( "1e2,1e4,1e6" );
+  visit_order_t order = RASTER_ORDER;
+  trace_level_t trace_level = TRACE_SUMMARY;
+  std::size_t cells_per_step = 1;
+  std::string format = "csv";
+  std::string output_filename;
+
+  // parse the arguments
+  for( int i = 1; i < argc; ++i ) {
+    std::string arg = argv[i];
+    bool has_value = ( i + 1 < argc );
+    std::string value = has_value ? argv[i+1] : "";
+    if( arg == "--points" && has_value ) {
+      point_counts = parse_sizes( value );
+    } else if( arg == "--cells" && has_value ) {
+      cell_counts = parse_sizes( value );
+    } else if( arg == "--order" && ( value == "raster" || value == "random" ) ) {
+      order = ( value == "raster" ) ? RASTER_ORDER : RANDOM_ORDER;
+    } else if( arg == "--trace-level" && value == "off" ) {
+      trace_level = TRACE_OFF;
+    } else if( arg == "--trace-level" && value == "summary" ) {
+      trace_level = TRACE_SUMMARY;
+    } else if( arg == "--trace-level" && value == "sampled" ) {
+      trace_level = TRACE_SAMPLED;
+    } else if( arg == "--trace-level" && value == "full" ) {
+      trace_level = TRACE_FULL;
+    } else if( arg == "--cells-per-step" && has_value ) {
+      cells_per_step = std::strtoul( value.c_str(), NULL, 10 );
+    } else if( arg == "--format" && ( value == "csv" || value == "json" ) ) {
+      format = value;
+    } else if( arg == "--output" && has_value ) {
+      output_filename = value;
+    } else {
+      usage();
+      return 2;
+    }
+    ++i;
+  }
+
+  // run every combination
+  std::vector<scaling_result_t> results;
+  for( std::size_t p = 0; p < point_counts.size(); ++p ) {
+    for( std::size_t c = 0; c < cell_counts.size(); ++c ) {
+      std::cerr << "-- " << point_counts[p] << " points, "
+		<< cell_counts[c] << " cells" << std::endl;
+      results.push_back( run_scaling( point_counts[p],
+				      cell_counts[c],
+				      order,
+				      trace_level,
+				      cells_per_step ) );
+    }
+  }
+
+  // write out the results
+  std::ofstream out_file;
+  if( !output_filename.empty() ) {
+    out_file.open( output_filename.c_str() );
+  }
+  write_results( output_filename.empty() ? std::cout : out_file,
+		 results,
+		 format == "json" );
+
+  return 0;
+}
@@ -0,0 +1,197 @@
+
+#if !defined( __P2L_POINT_PROCESS_EXPERIMENT_CORE_TEST_stub_planner_HPP__ )
+#define __P2L_POINT_PROCESS_EXPERIMENT_CORE_TEST_stub_planner_HPP__
+
+#include <planner-core/planner.hpp>
+#include <point-process-core/point_process.hpp>
+#include <point-process-core/marked_grid.hpp>
+#include <math-core/geom.hpp>
+#include <boost/shared_ptr.hpp>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+// Description:
+// Deterministic, (nearly) free stand-ins for a point process model and
+// a grid planner, used to measure the cost of the experiment harness
+// itself without any real MCMC inference.
+namespace stub_planner {
+
+
+  // Description:
+  // A "model" which only remembers what it was told.
+  // Updates are O(#new observations), mcmc does nothing but count
+  // steps and samples are just the observations.
+  class stub_point_process_t
+    : public point_process_core::mcmc_point_process_t
+  {
+  public:
+
+    explicit stub_point_process_t( const math_core::nd_aabox_t& window )
+      : _window( window ),
+	_num_negative_observations( 0 ),
+	_num_mcmc_steps( 0 )
+    {}
+
+    virtual math_core::nd_aabox_t window() const
+    { return _window; }
+
+    virtual boost::shared_ptr<point_process_core::mcmc_point_process_t>
+    clone() const
+    {
+      return boost::shared_ptr<point_process_core::mcmc_point_process_t>
+	( new stub_point_process_t( *this ) );
+    }
+
+    virtual std::vector<math_core::nd_point_t> observations() const
+    { return _observations; }
+
+    virtual void
+    add_observations( const std::vector<math_core::nd_point_t>& obs )
+    { _observations.insert( _observations.end(), obs.begin(), obs.end() ); }
+
+    virtual void
+    add_negative_observation( const math_core::nd_aabox_t& region )
+    { ++_num_negative_observations; }
+
+    virtual std::vector<math_core::nd_point_t> sample_and_step()
+    {
+      ++_num_mcmc_steps;
+      return _observations;
+    }
+
+    virtual void mcmc( const unsigned long num_iterations )
+    { _num_mcmc_steps += num_iterations; }
+
+    virtual void print_shallow_trace( std::ostream& out ) const
+    {
+      out << "stub-process #obs= " << _observations.size()
+	  << " #neg= " << _num_negative_observations
+	  << " #mcmc= " << _num_mcmc_steps;
+    }
+
+  protected:
+    math_core::nd_aabox_t _window;
+    std::vector<math_core::nd_point_t> _observations;
+    std::size_t _num_negative_observations;
+    unsigned long _num_mcmc_steps;
+  };
+
+
+  // Description:
+  // The order a stub_grid_planner_t visits cells in
+  enum visit_order_t
+  {
+    RASTER_ORDER,
+    RANDOM_ORDER
+  };
+
+
+  // Description:
+  // A planner which visits the cells of its grid in raster (or a
+  // seeded random) order, skipping visited cells, with O(1) updates.
+  // Choosing a cell is amortized O(1).
+  class stub_grid_planner_t
+    : public planner_core::grid_planner_t
+  {
+  public:
+
+    stub_grid_planner_t( const boost::shared_ptr<point_process_core::mcmc_point_process_t>& process,
+			 const double cell_size,
+			 const visit_order_t order = RASTER_ORDER,
+			 const unsigned int seed = 0 )
+      : _process( process ),
+	_visited( process->window(), cell_size ),
+	_next( 0 )
+    {
+      _params.burnin_mcmc_iterations = 0;
+      _params.update_model_mcmc_iterations = 1;
+      _order = _visited.all_cells();
+      if( order == RANDOM_ORDER ) {
+	std::mt19937 rng( seed );
+	std::shuffle( _order.begin(), _order.end(), rng );
+      }
+    }
+
+    virtual point_process_core::marked_grid_cell_t
+    choose_next_observation_cell()
+    {
+      while( _next < _order.size() && is_visited( _order[ _next ] ) ) {
+	++_next;
+      }
+      if( _next >= _order.size() ) {
+	throw std::logic_error( "stub_grid_planner_t: every cell has been visited" );
+      }
+      return _order[ _next ];
+    }
+
+    virtual std::vector<math_core::nd_point_t> observations() const
+    { return _process->observations(); }
+
+    virtual void
+    add_observations( const std::vector<math_core::nd_point_t>& obs )
+    {
+      _process->add_observations( obs );
+      _process->mcmc( (unsigned long)_params.update_model_mcmc_iterations );
+    }
+
+    virtual void
+    add_negative_observation( const point_process_core::marked_grid_cell_t& cell )
+    {
+      _process->add_negative_observation( _visited.region( cell ) );
+      _process->mcmc( (unsigned long)_params.update_model_mcmc_iterations );
+    }
+
+    virtual void add_empty_region( const math_core::nd_aabox_t& region )
+    { _process->add_negative_observation( region ); }
+
+    virtual void
+    add_visited_cell( const point_process_core::marked_grid_cell_t& cell )
+    { _visited.set( cell, true ); }
+
+    virtual void set_current_position( const math_core::nd_point_t& pos )
+    { _position = pos; }
+
+    virtual point_process_core::marked_grid_t<bool> visited_grid() const
+    { return _visited; }
+
+    virtual planner_core::grid_planner_parameters_t
+    get_grid_planner_parameters() const
+    { return _params; }
+
+    virtual void
+    set_grid_planner_parameters( const planner_core::grid_planner_parameters_t& p )
+    { _params = p; }
+
+    virtual boost::shared_ptr<point_process_core::mcmc_point_process_t>
+    get_process() const
+    { return _process; }
+
+    virtual void print_shallow_trace( std::ostream& out ) const
+    { out << "stub-planner next= " << _next << " / " << _order.size(); }
+
+    virtual void print_model_shallow_trace( std::ostream& out ) const
+    { _process->print_shallow_trace( out ); }
+
+  protected:
+
+    bool is_visited( const point_process_core::marked_grid_cell_t& cell ) const
+    {
+      boost::optional<bool> v = _visited( cell );
+      return v && *v;
+    }
+
+    boost::shared_ptr<point_process_core::mcmc_point_process_t> _process;
+    point_process_core::marked_grid_t<bool> _visited;
+    std::vector<point_process_core::marked_grid_cell_t> _order;
+    std::size_t _next;
+    planner_core::grid_planner_parameters_t _params;
+    math_core::nd_point_t _position;
+  };
+
+}
+
+#endif
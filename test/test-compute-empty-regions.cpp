@@ -0,0 +1,224 @@
+
+// Regression cases for compute_empty_regions in 1D, 2D (the sweep)
+// and 3D (the k-d split): points on the cell boundary, on another
+// point's epsilon slab edge and at coordinates too large for
+// +-epsilon to change them used to recurse forever or lose regions.
+//
+// Exits with status 1 if any returned region is outside the cell or
+// has a point strictly inside it, or if a sample of the cell farther
+// than epsilon (along some axis) from every point is in no region.
+
+#include <point-process-experiment-core/geometry.hpp>
+#include <math-core/geom.hpp>
+#include <math-core/io.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+using namespace math_core;
+using namespace point_process_experiment_core;
+
+
+//========================================================================
+
+// Description:
+// True iff p is strictly inside the box along every axis
+bool strictly_inside( const nd_point_t& p, const nd_aabox_t& box )
+{
+  for( int d = 0; d < p.n; ++d ) {
+    if( !( box.start.coordinate[d] < p.coordinate[d] &&
+	   p.coordinate[d] < box.end.coordinate[d] ) ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//========================================================================
+
+nd_point_t point3( const double x, const double y, const double z )
+{
+  std::vector<double> c( 3 );
+  c[0] = x;
+  c[1] = y;
+  c[2] = z;
+  return point( c );
+}
+
+//========================================================================
+
+// Description:
+// True iff p is inside the (closed) box
+bool inside( const nd_point_t& p, const nd_aabox_t& box )
+{
+  for( int d = 0; d < p.n; ++d ) {
+    if( p.coordinate[d] < box.start.coordinate[d] ||
+	p.coordinate[d] > box.end.coordinate[d] ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//========================================================================
+
+// Description:
+// True iff p is farther than epsilon from every point along some axis
+bool away_from_points( const nd_point_t& p,
+		       const std::vector<nd_point_t>& points,
+		       const double epsilon )
+{
+  for( size_t i = 0; i < points.size(); ++i ) {
+    bool near = true;
+    for( int d = 0; d < p.n; ++d ) {
+      if( std::fabs( p.coordinate[d] - points[i].coordinate[d] ) > epsilon ) {
+	near = false;
+      }
+    }
+    if( near ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//========================================================================
+
+// Description:
+// The samples-per-axis grid of sample points of the cell (including
+// its boundary)
+std::vector<nd_point_t> sample_grid( const nd_aabox_t& cell,
+				     const size_t samples_per_axis )
+{
+  const int n = cell.start.n;
+  size_t total = 1;
+  for( int d = 0; d < n; ++d ) {
+    total *= samples_per_axis;
+  }
+  std::vector<nd_point_t> samples;
+  for( size_t k = 0; k < total; ++k ) {
+    std::vector<double> c( n );
+    size_t rest = k;
+    for( int d = 0; d < n; ++d ) {
+      size_t i = rest % samples_per_axis;
+      rest /= samples_per_axis;
+      double width = cell.end.coordinate[d] - cell.start.coordinate[d];
+      c[d] = cell.start.coordinate[d] + width * i / ( samples_per_axis - 1 );
+    }
+    samples.push_back( point( c ) );
+  }
+  return samples;
+}
+
+//========================================================================
+
+bool check( const std::string& name,
+	    const std::vector<nd_point_t>& points,
+	    const nd_aabox_t& cell,
+	    const double epsilon = 1e-7 )
+{
+  std::vector<nd_aabox_t> regions = compute_empty_regions( points, cell, epsilon );
+
+  // sound: inside the cell and without points
+  bool ok = true;
+  for( size_t r = 0; r < regions.size(); ++r ) {
+    for( int d = 0; d < cell.start.n; ++d ) {
+      if( regions[r].start.coordinate[d] < cell.start.coordinate[d] ||
+	  regions[r].end.coordinate[d] > cell.end.coordinate[d] ) {
+	ok = false;
+      }
+    }
+    for( size_t i = 0; i < points.size(); ++i ) {
+      if( strictly_inside( points[i], regions[r] ) ) {
+	ok = false;
+      }
+    }
+  }
+
+  // covering: everything away from the points is in some region
+  std::vector<nd_point_t> samples = sample_grid( cell, cell.start.n < 3 ? 41 : 17 );
+  size_t uncovered = 0;
+  for( size_t s = 0; s < samples.size(); ++s ) {
+    if( !away_from_points( samples[s], points, epsilon ) ) {
+      continue;
+    }
+    bool covered = false;
+    for( size_t r = 0; r < regions.size() && !covered; ++r ) {
+      covered = inside( samples[s], regions[r] );
+    }
+    if( !covered ) {
+      ++uncovered;
+    }
+  }
+  if( uncovered > 0 ) {
+    ok = false;
+  }
+
+  std::cout << ( ok ? "ok   " : "FAIL " ) << name
+	    << " (" << regions.size() << " regions, "
+	    << uncovered << " uncovered samples)" << std::endl;
+  return ok;
+}
+
+//========================================================================
+
+int main( int argc, char** argv )
+{
+  bool ok = true;
+  const double eps = 1e-7;
+
+  // 1D
+  nd_aabox_t line = aabox( point( 0.0 ), point( 1.0 ) );
+  ok &= check( "1d point on cell start",
+	       std::vector<nd_point_t>( 1, point( 0.0 ) ), line );
+  ok &= check( "1d point on cell end",
+	       std::vector<nd_point_t>( 1, point( 1.0 ) ), line );
+  std::vector<nd_point_t> slab_edge;
+  slab_edge.push_back( point( 0.5 ) );
+  slab_edge.push_back( point( 0.5 - eps ) );
+  slab_edge.push_back( point( 0.5 + eps ) );
+  ok &= check( "1d points on slab edges", slab_edge, line, eps );
+  nd_aabox_t far_line = aabox( point( 1e10 ), point( 1e10 + 1.0 ) );
+  ok &= check( "1d point where +-epsilon rounds away",
+	       std::vector<nd_point_t>( 1, point( 1e10 ) ), far_line, eps );
+  nd_aabox_t long_line = aabox( point( 0.0 ), point( 1e10 ) );
+  ok &= check( "1d point inside where +-epsilon rounds away",
+	       std::vector<nd_point_t>( 1, point( 5e9 ) ), long_line, eps );
+
+  // 2D
+  nd_aabox_t square = aabox( point( 0.0, 0.0 ), point( 1.0, 1.0 ) );
+  ok &= check( "2d point on cell edge",
+	       std::vector<nd_point_t>( 1, point( 1.0, 0.5 ) ), square );
+  ok &= check( "2d point on cell corner",
+	       std::vector<nd_point_t>( 1, point( 0.0, 0.0 ) ), square );
+  ok &= check( "2d point within epsilon of the cell edge",
+	       std::vector<nd_point_t>( 1, point( 0.0005, 0.5 ) ), square, 1e-3 );
+  std::vector<nd_point_t> square_slab_edge;
+  square_slab_edge.push_back( point( 0.5, 0.5 ) );
+  square_slab_edge.push_back( point( 0.5 - eps, 0.5 + eps ) );
+  square_slab_edge.push_back( point( 0.5 + eps, 0.25 ) );
+  ok &= check( "2d points on slab edges", square_slab_edge, square, eps );
+  std::vector<nd_point_t> scattered;
+  for( int i = 0; i < 20; ++i ) {
+    scattered.push_back( point( ( i * 7 % 20 ) / 19.0, ( i * 13 % 20 ) / 23.0 ) );
+  }
+  ok &= check( "2d scattered points", scattered, square, 0.01 );
+  nd_aabox_t far_square = aabox( point( 1e10, 1e10 ), point( 1e10 + 1.0, 1e10 + 1.0 ) );
+  ok &= check( "2d point where +-epsilon rounds away",
+	       std::vector<nd_point_t>( 1, point( 1e10 + 0.5, 1e10 ) ), far_square, eps );
+
+  // 3D
+  nd_aabox_t cube = aabox( point3( 0.0, 0.0, 0.0 ), point3( 1.0, 1.0, 1.0 ) );
+  ok &= check( "3d point on cell face",
+	       std::vector<nd_point_t>( 1, point3( 1.0, 0.5, 0.5 ) ), cube );
+  ok &= check( "3d point on cell corner",
+	       std::vector<nd_point_t>( 1, point3( 0.0, 0.0, 0.0 ) ), cube );
+  std::vector<nd_point_t> cube_slab_edge;
+  cube_slab_edge.push_back( point3( 0.5, 0.5, 0.5 ) );
+  cube_slab_edge.push_back( point3( 0.5 - eps, 0.5, 0.5 - eps ) );
+  cube_slab_edge.push_back( point3( 0.5 + eps, 1.0, 0.5 ) );
+  ok &= check( "3d points on slab edges", cube_slab_edge, cube, eps );
+
+  return ok ? 0 : 1;
+}